@@ -26,6 +26,23 @@ PLEASE FILL OUT THIS SECTION PRIOR TO SUBMISSION
 #include <unistd.h>  // for getcwd
 #include <limits.h>  // for PATH_MAX
 #include <sstream>   // for std::stringstream
+#include <cstdlib>   // for atoi, atof, malloc and free
+#include <thread>    // for std::thread, splitting rows across cores
+#include <functional> // for std::function
+#include <atomic>    // for std::atomic, counters bumped from several threads
+#include <chrono>    // for std::chrono timing in the benchmarks
+#include <mutex>     // for std::mutex, guards the trace events
+#include <cstdio>    // for remove
+#include <cctype>    // for isalpha and isdigit
+#include <new>       // for std::bad_alloc
+#include <ctime>     // for clock, cpu time in the --stats output
+#include <cstdint>   // for uint8_t and uint16_t, the masks and the median filter's histogram counts
+#include <sys/resource.h> // for getrusage, peak memory in the --stats output
+#ifdef __linux__
+#include <linux/perf_event.h> // for perf_event_attr, hardware counters with --perf
+#include <sys/syscall.h>      // for syscall, glibc has no perf_event_open wrapper
+#include <sys/ioctl.h>        // for ioctl, starting and stopping the counters
+#endif
 using namespace std; // for "std::" prefix
 
 //***************************************************************************************************//
@@ -244,16 +261,600 @@ bool write_image(string filename, const vector<vector<Pixel>> &image);
 vector<vector<Pixel>> process_1(const vector<vector<Pixel>> &image);
 vector<vector<Pixel>> process_2(const vector<vector<Pixel>> &image);
 vector<vector<Pixel>> process_3(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_3(vector<vector<Pixel>> &&image);
 vector<vector<Pixel>> process_4(const vector<vector<Pixel>> &image);
 vector<vector<Pixel>> process_5(const vector<vector<Pixel>> &image);
 vector<vector<Pixel>> process_6(const vector<vector<Pixel>> &image);
 vector<vector<Pixel>> process_7(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_7(vector<vector<Pixel>> &&image);
 vector<vector<Pixel>> process_8(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_8(vector<vector<Pixel>> &&image);
 vector<vector<Pixel>> process_9(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_9(vector<vector<Pixel>> &&image);
 vector<vector<Pixel>> process_10(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_10(vector<vector<Pixel>> &&image);
 vector<vector<Pixel>> process_11(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_11(vector<vector<Pixel>> &&image);
+vector<vector<Pixel>> process_12(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_12(vector<vector<Pixel>> &&image);
+vector<vector<Pixel>> process_13(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_13(vector<vector<Pixel>> &&image);
+vector<vector<Pixel>> process_14(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_14(vector<vector<Pixel>> &&image);
+vector<vector<Pixel>> process_15(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_15(vector<vector<Pixel>> &&image);
+vector<vector<Pixel>> process_16(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_17(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_18(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_19(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_20(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_21(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_22(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_23(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_24(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> process_25(const vector<vector<Pixel>> &image);
 
 vector<vector<Pixel>> rotate_90_degrees(const vector<vector<Pixel>> &image);
+vector<vector<Pixel>> rotate_clockwise(const vector<vector<Pixel>> &image, int num_rotations);
+vector<vector<Pixel>> enlarge(const vector<vector<Pixel>> &image, double xscale, double yscale);
+vector<vector<Pixel>> resample(const vector<vector<Pixel>> &image, double xscale, double yscale, int method);
+
+// --trace: spans recorded while the program runs, written out as Chrome trace event JSON (open it in chrome://tracing
+// or ui.perfetto.dev) to see which stage took the time and whether every thread had work
+struct TraceEvent
+{
+    string name;
+    string category;
+    long long start_us;
+    long long duration_us;
+    int thread_id;
+};
+
+struct Tracer
+{
+    bool enabled = false;
+    mutex lock; // worker threads add their spans too
+    vector<TraceEvent> events;
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+};
+
+Tracer tracer;
+
+// small number for the current thread (the main thread is 0), thread::id itself doesn't print nicely
+int trace_thread_id()
+{
+    static atomic<int> next_id(0);
+    thread_local int id = next_id++;
+    return id;
+}
+
+// records a span from when it is created until it goes out of scope, does nothing unless --trace is on
+struct TraceSpan
+{
+    string name;
+    string category;
+    chrono::steady_clock::time_point start;
+
+    TraceSpan(const string &span_name, const string &span_category)
+    {
+        if (tracer.enabled)
+        {
+            name = span_name;
+            category = span_category;
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        finish();
+    }
+
+    // ends the span early, before it goes out of scope
+    void finish()
+    {
+        if (!tracer.enabled || name.empty())
+        {
+            return;
+        }
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        TraceEvent event;
+        event.name = name;
+        event.category = category;
+        event.start_us = chrono::duration_cast<chrono::microseconds>(start - tracer.origin).count();
+        event.duration_us = chrono::duration_cast<chrono::microseconds>(end - start).count();
+        event.thread_id = trace_thread_id();
+        name.clear();
+        lock_guard<mutex> guard(tracer.lock);
+        tracer.events.push_back(event);
+    }
+};
+
+// filenames end up in the trace and the stats log as JSON strings, so quotes and backslashes need escaping
+string json_escape(const string &text)
+{
+    string escaped;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += text[i];
+    }
+    return escaped;
+}
+
+bool write_trace(const string &filename)
+{
+    ofstream stream(filename);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    lock_guard<mutex> guard(tracer.lock);
+    stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+    for (size_t i = 0; i < tracer.events.size(); i++)
+    {
+        const TraceEvent &event = tracer.events[i];
+        stream << "  {\"name\": \"" << json_escape(event.name) << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"ts\": "
+               << event.start_us << ", \"dur\": " << event.duration_us << ", \"pid\": 1, \"tid\": " << event.thread_id << "}"
+               << (i + 1 == tracer.events.size() ? "" : ",") << endl;
+    }
+    stream << "]}" << endl;
+    return true;
+}
+
+// helper function that splits rows 0..num_rows into one strip per core and runs body(first_row, end_row) on each strip
+// the calling thread takes the first strip itself, small images (or single core machines) just run in one go
+void parallel_rows(int num_rows, const function<void(int, int)> &body)
+{
+    const int MIN_ROWS_PER_STRIP = 16; // below this the thread start up costs more than it saves
+    int num_threads = thread::hardware_concurrency();
+    num_threads = min(num_threads, num_rows / MIN_ROWS_PER_STRIP);
+    // each strip shows up as its own span with --trace, so idle or slow threads stand out
+    auto traced_body = [&body](int first_row, int end_row)
+    {
+        TraceSpan span("rows " + to_string(first_row) + "-" + to_string(end_row), "strip");
+        body(first_row, end_row);
+    };
+    if (num_threads <= 1)
+    {
+        traced_body(0, num_rows);
+        return;
+    }
+
+    int strip = (num_rows + num_threads - 1) / num_threads;
+    vector<thread> workers;
+    for (int first = strip; first < num_rows; first += strip)
+    {
+        workers.push_back(thread(traced_body, first, min(num_rows, first + strip)));
+    }
+    traced_body(0, strip);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+// image pool: every filter used to build a brand new image (one allocation per row), so instead finished images get handed
+// back here and the next filter that needs the same size takes one instead of allocating. this is only used from the main
+// thread, the parallel parts of the filters only write into images that were already handed out
+struct ImagePool
+{
+    vector<vector<vector<Pixel>>> free_images; // oldest first
+    long max_bytes = 256L << 20;                // most the spares may hold, even idle at the menu (--pool-cap, in MB)
+    long bytes = 0;                             // held by free_images right now
+    long hits = 0;                              // acquire_image found a spare of the right size
+    long misses = 0;                            // acquire_image had to allocate
+    long released = 0;                          // images handed back
+    long dropped = 0;                           // spares thrown away (or not kept) to stay under max_bytes
+};
+
+ImagePool image_pool;
+
+// pixel memory of an image, what the pool's cap counts
+long image_bytes(const vector<vector<Pixel>> &image)
+{
+    return image.empty() ? 0 : static_cast<long>(image.size()) * image[0].size() * sizeof(Pixel);
+}
+
+// gets a num_rows x num_columns image from the pool (or a new one), the pixel values are left over from whatever used it
+// before so the caller has to write every pixel
+vector<vector<Pixel>> acquire_image(int num_rows, int num_columns)
+{
+    for (size_t i = 0; i < image_pool.free_images.size(); i++)
+    {
+        vector<vector<Pixel>> &spare = image_pool.free_images[i];
+        if (static_cast<int>(spare.size()) == num_rows && static_cast<int>(spare[0].size()) == num_columns)
+        {
+            vector<vector<Pixel>> image = move(spare);
+            image_pool.free_images.erase(image_pool.free_images.begin() + i);
+            image_pool.bytes -= image_bytes(image);
+            image_pool.hits++;
+            return image;
+        }
+    }
+    image_pool.misses++;
+    return vector<vector<Pixel>>(num_rows, vector<Pixel>(num_columns));
+}
+
+// hands an image that is no longer needed back to the pool, leaves image empty. the oldest spares make room for it, and
+// an image bigger than the whole cap is freed straight away
+void release_image(vector<vector<Pixel>> &image)
+{
+    long size = image_bytes(image);
+    if (size == 0)
+    {
+        image.clear();
+        return;
+    }
+    image_pool.released++;
+    if (size > image_pool.max_bytes)
+    {
+        image_pool.dropped++;
+        image.clear();
+        return;
+    }
+    while (image_pool.bytes + size > image_pool.max_bytes)
+    {
+        image_pool.bytes -= image_bytes(image_pool.free_images.front());
+        image_pool.free_images.erase(image_pool.free_images.begin());
+        image_pool.dropped++;
+    }
+    image_pool.free_images.push_back(move(image));
+    image_pool.bytes += size;
+    image.clear();
+}
+
+// copy of an image using pooled memory, assigning into a row of the same size does not allocate
+vector<vector<Pixel>> copy_image(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    for (size_t row = 0; row < image.size(); ++row)
+    {
+        new_image[row] = image[row];
+    }
+    return new_image;
+}
+
+void print_pool_stats()
+{
+    long requests = image_pool.hits + image_pool.misses;
+    cout << "image pool: " << image_pool.hits << " hits, " << image_pool.misses << " misses";
+    if (requests > 0)
+    {
+        cout << " (" << 100 * image_pool.hits / requests << "% reused)";
+    }
+    cout << ", " << image_pool.released << " released, " << image_pool.dropped << " dropped, holding "
+         << image_pool.bytes / (1 << 20) << " MB of " << image_pool.max_bytes / (1 << 20) << " MB" << endl;
+}
+
+// allocation tracking: every operator new in the program goes through the replacement below (vector included), so
+// sampling these before and after a call tells how many heap allocations it made and how much memory it needed at most.
+// each block carries its size in a small header in front of it so operator delete knows how much is being given back
+atomic<long> allocation_count(0);      // total allocations so far
+atomic<long> allocation_bytes(0);      // total bytes ever allocated
+atomic<long> allocation_live_bytes(0); // bytes allocated and not freed yet
+atomic<long> allocation_peak_bytes(0); // highest live_bytes since the last reset_allocation_peak()
+
+const size_t ALLOCATION_HEADER = 16; // keeps the memory handed out 16 byte aligned, same as malloc
+
+// gcc inlines these into callers and then warns about the header arithmetic it can no longer see through
+#ifdef __GNUC__
+#define ALLOCATION_NOINLINE __attribute__((noinline))
+#else
+#define ALLOCATION_NOINLINE
+#endif
+
+// the header arithmetic shared by every form of new and delete below. returns nullptr when malloc fails
+ALLOCATION_NOINLINE void *tracked_allocate(size_t size)
+{
+    char *block = static_cast<char *>(malloc(size + ALLOCATION_HEADER));
+    if (block == nullptr)
+    {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t *>(block) = size;
+
+    allocation_count++;
+    allocation_bytes += size;
+    long live = allocation_live_bytes += size;
+    long peak = allocation_peak_bytes;
+    while (live > peak && !allocation_peak_bytes.compare_exchange_weak(peak, live))
+    {
+        // another thread moved the peak, try again against its value
+    }
+    return block + ALLOCATION_HEADER;
+}
+
+ALLOCATION_NOINLINE void tracked_free(void *memory)
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+    char *block = static_cast<char *>(memory) - ALLOCATION_HEADER;
+    allocation_live_bytes -= *reinterpret_cast<size_t *>(block);
+    free(block);
+}
+
+// every form has to be replaced, the library's own versions (sized delete in C++14, the array and nothrow ones) don't
+// know about the header and would free the wrong pointer
+void *operator new(size_t size)
+{
+    void *memory = tracked_allocate(size);
+    if (memory == nullptr)
+    {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    return tracked_allocate(size);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+    return tracked_allocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    tracked_free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    tracked_free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    tracked_free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    tracked_free(memory);
+}
+
+void operator delete(void *memory, const nothrow_t &) noexcept
+{
+    tracked_free(memory);
+}
+
+void operator delete[](void *memory, const nothrow_t &) noexcept
+{
+    tracked_free(memory);
+}
+
+// starts a new peak measurement from whatever is allocated right now
+void reset_allocation_peak()
+{
+    allocation_peak_bytes = allocation_live_bytes.load();
+}
+
+// total time spent sitting at a prompt inside a filter (process 5 and 6 ask for numbers), the stopwatch takes it back out
+// so --stats only counts the time the filter was actually working
+double prompt_wait_ms = 0;
+
+// prints the message and reads the answer into value, keeping track of how long the user took
+template <typename T>
+void prompt(const string &message, T &value)
+{
+    TraceSpan span("waiting for input", "prompt"); // so a slow user doesn't look like a slow filter in the trace
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    cout << message;
+    cin >> value;
+    prompt_wait_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// what one stage of a job cost: wall and cpu time (cpu time counts every thread, so it can be more than the wall time)
+// and heap use (peak_bytes is how far the stage pushed memory above what was already allocated when it started)
+struct StageStats
+{
+    double wall_ms = 0;
+    double cpu_ms = 0;
+    long allocations = 0;
+    long allocated_bytes = 0;
+    long peak_bytes = 0;
+};
+
+// starts timing when it is created, elapsed() gives the time since then minus any time spent at a prompt, plus the
+// allocations made since then. only one should be running at a time since it resets the allocation peak
+struct Stopwatch
+{
+    chrono::steady_clock::time_point wall_start;
+    clock_t cpu_start;
+    double prompt_wait_start;
+    long count_start;
+    long bytes_start;
+    long live_start;
+
+    Stopwatch() : wall_start(chrono::steady_clock::now()), cpu_start(clock()), prompt_wait_start(prompt_wait_ms),
+                  count_start(allocation_count), bytes_start(allocation_bytes), live_start(allocation_live_bytes)
+    {
+        reset_allocation_peak();
+    }
+
+    StageStats elapsed() const
+    {
+        StageStats time;
+        time.wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - wall_start).count() -
+                       (prompt_wait_ms - prompt_wait_start);
+        time.cpu_ms = 1000.0 * (clock() - cpu_start) / CLOCKS_PER_SEC;
+        time.allocations = allocation_count - count_start;
+        time.allocated_bytes = allocation_bytes - bytes_start;
+        time.peak_bytes = allocation_peak_bytes - live_start;
+        return time;
+    }
+};
+
+// --perf: hardware performance counters (linux only) read around each filter call
+const int NUM_PERF_EVENTS = 5;
+const char *PERF_EVENT_NAMES[NUM_PERF_EVENTS] = {"cycles", "instructions", "cache_misses", "branch_misses", "dtlb_misses"};
+
+// counter values for one measurement, valid[i] is false when the machine (or a container) won't give us that counter
+struct PerfSample
+{
+    long long values[NUM_PERF_EVENTS] = {0};
+    bool valid[NUM_PERF_EVENTS] = {false};
+
+    bool any() const
+    {
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            if (valid[i])
+                return true;
+        }
+        return false;
+    }
+};
+
+// one perf_event_open counter per event, user space only so it works without root. inherit makes the counters follow
+// the worker threads parallel_rows starts, so a parallel filter is counted in full. inherit rules out reading them as one
+// group, so when the CPU has fewer counters than events and the kernel takes turns, each count is scaled up by how long
+// it was actually counting (enabled time / running time), like perf stat does
+struct PerfCounters
+{
+    bool enabled = false;
+    bool opened = false;
+    int fds[NUM_PERF_EVENTS] = {-1, -1, -1, -1, -1};
+
+    void open()
+    {
+        opened = true;
+#ifdef __linux__
+        const unsigned types[NUM_PERF_EVENTS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                 PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+        const unsigned long long configs[NUM_PERF_EVENTS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            struct perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    void start()
+    {
+        if (!opened)
+        {
+            open();
+        }
+#ifdef __linux__
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            if (fds[i] >= 0)
+            {
+                ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    PerfSample stop()
+    {
+        PerfSample sample;
+#ifdef __linux__
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            if (fds[i] >= 0)
+            {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                unsigned long long reading[3] = {0}; // value, time enabled, time running
+                if (read(fds[i], reading, sizeof(reading)) == sizeof(reading) && reading[2] > 0)
+                {
+                    sample.valid[i] = true;
+                    sample.values[i] = static_cast<long long>(static_cast<double>(reading[0]) * reading[1] / reading[2]);
+                }
+            }
+        }
+#endif
+        return sample;
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            if (fds[i] >= 0)
+            {
+                close(fds[i]);
+            }
+        }
+#endif
+    }
+};
+
+PerfCounters perf_counters;
+
+// "cycles 1234 (5.6/pixel), ..." plus IPC, or a note that the counters aren't available
+string describe_perf(const PerfSample &sample, double pixels)
+{
+    if (!sample.any())
+    {
+        return "hardware counters not available (needs linux, perf_event_paranoid <= 2 and a CPU or VM that exposes them)";
+    }
+    stringstream out;
+    for (int i = 0; i < NUM_PERF_EVENTS; i++)
+    {
+        if (sample.valid[i])
+        {
+            out << PERF_EVENT_NAMES[i] << " " << sample.values[i] << " (" << sample.values[i] / pixels << "/pixel), ";
+        }
+    }
+    if (sample.valid[0] && sample.valid[1] && sample.values[0] > 0)
+    {
+        out << "IPC " << static_cast<double>(sample.values[1]) / sample.values[0];
+    }
+    return out.str();
+}
+
+// the same as a JSON object, counts divided by `divide_by` (the number of runs) and also given per pixel
+string perf_json(const PerfSample &sample, double pixels, double divide_by = 1)
+{
+    stringstream out;
+    out << "{";
+    bool first = true;
+    for (int i = 0; i < NUM_PERF_EVENTS; i++)
+    {
+        if (sample.valid[i])
+        {
+            out << (first ? "" : ", ") << "\"" << PERF_EVENT_NAMES[i] << "\": " << static_cast<long long>(sample.values[i] / divide_by)
+                << ", \"" << PERF_EVENT_NAMES[i] << "_per_pixel\": " << sample.values[i] / divide_by / pixels;
+            first = false;
+        }
+    }
+    if (sample.valid[0] && sample.valid[1] && sample.values[0] > 0)
+    {
+        out << ", \"ipc\": " << static_cast<double>(sample.values[1]) / sample.values[0];
+    }
+    out << "}";
+    return out.str();
+}
+
+const int LAST_MENU_CHOICE = 25; // highest process number on the menu
 
 void display_menu()
 {
@@ -270,6 +871,20 @@ void display_menu()
     cout << "9. Darken the image by a scaling factor" << endl;
     cout << "10. Convert image to black, white, red, blue, and green" << endl;
     cout << "11. Turn image into cream pink" << endl;
+    cout << "12. Convert image to high contrast (automatic threshold)" << endl;
+    cout << "13. Lighten or darken the image automatically (auto exposure)" << endl;
+    cout << "14. Stretch the colors to the full range (auto levels)" << endl;
+    cout << "15. Even out the brightness levels (histogram equalization)" << endl;
+    cout << "16. Blur the image" << endl;
+    cout << "17. Emboss the image" << endl;
+    cout << "18. Detect edges" << endl;
+    cout << "19. Sharpen the image" << endl;
+    cout << "20. Remove noise (median filter)" << endl;
+    cout << "21. Clean up a black and white image (erode / dilate / open / close)" << endl;
+    cout << "22. Find connected regions" << endl;
+    cout << "23. Dither (soft black and white or five colors)" << endl;
+    cout << "24. Apply a color look (3D LUT / .cube file)" << endl;
+    cout << "25. Reduce to a palette of colors" << endl;
     cout << "Q. Quit" << endl;
     cout << "_____________________" << endl;
     cout << "Enter your choice: ";
@@ -280,7 +895,7 @@ vector<vector<Pixel>> process_1(const vector<vector<Pixel>> &image)
 {
     int num_rows = image.size();
     int num_columns = image[0].size();
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    vector<vector<Pixel>> new_image = acquire_image(num_rows, num_columns);
 
     double center_x = num_columns / 2.0;
     double center_y = num_rows / 2.0;
@@ -307,7 +922,7 @@ vector<vector<Pixel>> process_2(const vector<vector<Pixel>> &image)
     int width = image[0].size();
     int height = image.size();
     double scaling_factor = 0.3;
-    vector<vector<Pixel>> new_image(height, vector<Pixel>(width));
+    vector<vector<Pixel>> new_image = acquire_image(height, width);
 
     for (int row = 0; row < height; ++row)
     {
@@ -350,31 +965,44 @@ vector<vector<Pixel>> process_2(const vector<vector<Pixel>> &image)
 }
 
 // process 3: grayscale (copy piazza measurements + same logic, this 1 is straight forward)
-vector<vector<Pixel>> process_3(const vector<vector<Pixel>> &image)
+// every output pixel only depends on the same input pixel, so this one (and 7 - 13) reads image and writes new_image in
+// one pass, and new_image can be image itself to work directly on it
+void process_3_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &new_image)
 {
     int width = image[0].size();
     int height = image.size();
-    vector<vector<Pixel>> new_image(height, vector<Pixel>(width));
 
     for (int row = 0; row < height; ++row)
     {
         for (int col = 0; col < width; ++col)
         {
-            Pixel p = image[row][col];
+            const Pixel &p = image[row][col];
             int gray_value = (p.red + p.green + p.blue) / 3;
             new_image[row][col] = {gray_value, gray_value, gray_value};
         }
     }
+}
 
+vector<vector<Pixel>> process_3(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    process_3_into(image, new_image);
     return new_image;
 }
 
+// when the caller is done with the input (process_3(move(image))), reuse its memory instead of allocating a copy
+vector<vector<Pixel>> process_3(vector<vector<Pixel>> &&image)
+{
+    process_3_into(image, image);
+    return move(image);
+}
+
 // process 4: rotate 90 degrees clockwise - make sure it's NOT COUNTERCLOCKWISE
 vector<vector<Pixel>> process_4(const vector<vector<Pixel>> &image)
 {
     int width = image[0].size();
     int height = image.size();
-    vector<vector<Pixel>> new_image(width, vector<Pixel>(height));
+    vector<vector<Pixel>> new_image = acquire_image(width, height);
 
     for (int row = 0; row < height; ++row)
     {
@@ -392,7 +1020,7 @@ vector<vector<Pixel>> rotate_by_90(const vector<vector<Pixel>> &image)
 {
     int width = image[0].size();
     int height = image.size();
-    vector<vector<Pixel>> new_image(width, vector<Pixel>(height));
+    vector<vector<Pixel>> new_image = acquire_image(width, height);
 
     for (int row = 0; row < height; ++row)
     {
@@ -405,230 +1033,4147 @@ vector<vector<Pixel>> rotate_by_90(const vector<vector<Pixel>> &image)
     return new_image;
 }
 
-// process 5: rotate multiples of 90 degrees clockwise NOT COUNTERCLOCKWISE - we will actually ask the user to input how much they wanna rotate
-vector<vector<Pixel>> process_5(const vector<vector<Pixel>> &image)
+// helper function for process 5: rotate clockwise num_rotations times without the prompt
+vector<vector<Pixel>> rotate_clockwise(const vector<vector<Pixel>> &image, int num_rotations)
+{
+    num_rotations = num_rotations % 4;
+
+    vector<vector<Pixel>> result_image = copy_image(image);
+    for (int i = 0; i < num_rotations; i++)
+    {
+        vector<vector<Pixel>> rotated = rotate_by_90(result_image);
+        release_image(result_image); // the 3rd rotation can reuse the 1st one's memory
+        result_image = move(rotated);
+    }
+    return result_image;
+}
+
+// process 5: rotate multiples of 90 degrees clockwise NOT COUNTERCLOCKWISE - we will actually ask the user to input how much they wanna rotate
+vector<vector<Pixel>> process_5(const vector<vector<Pixel>> &image)
+{
+    int num_rotations;
+    prompt("enter the number of 90-degree clockwise rotations: ", num_rotations);
+    return rotate_clockwise(image, num_rotations);
+}
+
+// helper function for process 6: nearest-neighbour enlarge without the prompts
+// the source column for every output column is worked out once up front, and each distinct output row is only built once,
+// the rows that repeat it (yscale > 1) are straight copies of the row before
+vector<vector<Pixel>> enlarge(const vector<vector<Pixel>> &image, double xscale, double yscale)
+{
+    int width = image[0].size();
+    int height = image.size();
+    int new_width = static_cast<int>(width * xscale);
+    int new_height = static_cast<int>(height * yscale);
+    vector<vector<Pixel>> new_image = acquire_image(new_height, new_width);
+
+    // whole number factors (2x, 4x...) can skip the division entirely, each source pixel just gets repeated
+    int int_xscale = static_cast<int>(xscale);
+    bool whole_x = xscale >= 1 && int_xscale == xscale;
+
+    // otherwise every output column looks up its source column in a table worked out once
+    vector<int> source_col;
+    if (!whole_x)
+    {
+        source_col.resize(new_width);
+        for (int col = 0; col < new_width; ++col)
+        {
+            source_col[col] = min(width - 1, static_cast<int>(col / xscale));
+        }
+    }
+
+    int previous_source_row = -1;
+    for (int row = 0; row < new_height; ++row)
+    {
+        int source_row = min(height - 1, static_cast<int>(row / yscale));
+        if (source_row == previous_source_row)
+        {
+            // same source row as the last output row, so just copy it over
+            new_image[row] = new_image[row - 1];
+            continue;
+        }
+        previous_source_row = source_row;
+
+        const vector<Pixel> &source = image[source_row];
+        vector<Pixel> &target = new_image[row];
+        if (whole_x)
+        {
+            for (int col = 0; col < width; ++col)
+            {
+                fill(target.begin() + col * int_xscale, target.begin() + (col + 1) * int_xscale, source[col]);
+            }
+        }
+        else
+        {
+            for (int col = 0; col < new_width; ++col)
+            {
+                target[col] = source[source_col[col]];
+            }
+        }
+    }
+    return new_image;
+}
+
+// resampling methods for process 6
+enum ResampleMethod
+{
+    RESAMPLE_NEAREST = 0,
+    RESAMPLE_BILINEAR = 1,
+    RESAMPLE_BICUBIC = 2, // catmull-rom
+    RESAMPLE_LANCZOS = 3  // lanczos with 3 lobes
+};
+
+// the filter kernels, x is the distance from the sample point in source pixels
+double resample_kernel(int method, double x)
+{
+    x = fabs(x);
+    if (method == RESAMPLE_BILINEAR)
+    {
+        return x < 1 ? 1 - x : 0;
+    }
+    if (method == RESAMPLE_BICUBIC)
+    {
+        if (x < 1)
+            return 1.5 * x * x * x - 2.5 * x * x + 1;
+        if (x < 2)
+            return -0.5 * x * x * x + 2.5 * x * x - 4 * x + 2;
+        return 0;
+    }
+    // lanczos: sinc(x) * sinc(x / 3)
+    if (x < 1e-8)
+        return 1;
+    if (x >= 3)
+        return 0;
+    const double PI = 3.14159265358979323846;
+    double pi_x = PI * x;
+    return 3 * sin(pi_x) * sin(pi_x / 3) / (pi_x * pi_x);
+}
+
+// precomputed weights for one axis: output pixel i reads source[index[i * taps + k]] * weight[i * taps + k] for k < taps
+// the indexes are already clamped to the edge, so the passes below never have to check the borders
+struct ResampleTaps
+{
+    int taps;
+    vector<int> index;
+    vector<float> weight;
+};
+
+ResampleTaps make_resample_taps(int source_size, int target_size, double scale, int method)
+{
+    double radius = method == RESAMPLE_BILINEAR ? 1 : (method == RESAMPLE_BICUBIC ? 2 : 3);
+    // when shrinking, stretch the kernel so every source pixel still gets counted (otherwise it aliases)
+    double filter_scale = max(1.0, 1.0 / scale);
+    int half = static_cast<int>(ceil(radius * filter_scale));
+
+    ResampleTaps result;
+    result.taps = 2 * half;
+    result.index.resize(target_size * result.taps);
+    result.weight.resize(target_size * result.taps);
+
+    for (int i = 0; i < target_size; i++)
+    {
+        double center = (i + 0.5) / scale - 0.5; // pixel centres line up, same as most image editors
+        int first = static_cast<int>(floor(center)) - half + 1;
+        double total = 0;
+        for (int k = 0; k < result.taps; k++)
+        {
+            double w = resample_kernel(method, (first + k - center) / filter_scale);
+            result.index[i * result.taps + k] = min(source_size - 1, max(0, first + k));
+            result.weight[i * result.taps + k] = w;
+            total += w;
+        }
+        // normalise so flat areas stay flat
+        for (int k = 0; k < result.taps; k++)
+        {
+            result.weight[i * result.taps + k] /= total;
+        }
+    }
+    return result;
+}
+
+// helper function for process 6: separable resample, a horizontal pass into a float buffer then a vertical pass out of it
+vector<vector<Pixel>> resample(const vector<vector<Pixel>> &image, double xscale, double yscale, int method)
+{
+    if (method == RESAMPLE_NEAREST)
+    {
+        return enlarge(image, xscale, yscale);
+    }
+
+    int width = image[0].size();
+    int height = image.size();
+    int new_width = static_cast<int>(width * xscale);
+    int new_height = static_cast<int>(height * yscale);
+
+    ResampleTaps horizontal = make_resample_taps(width, new_width, xscale, method);
+    ResampleTaps vertical = make_resample_taps(height, new_height, yscale, method);
+
+    // horizontal pass: every source row gets resized to the new width, stored as red, green, blue floats
+    int stride = new_width * 3;
+    vector<float> resized_rows(static_cast<size_t>(height) * stride);
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const vector<Pixel> &source = image[row];
+            float *target = &resized_rows[static_cast<size_t>(row) * stride];
+            for (int col = 0; col < new_width; ++col)
+            {
+                const int *index = &horizontal.index[col * horizontal.taps];
+                const float *weight = &horizontal.weight[col * horizontal.taps];
+                float red = 0, green = 0, blue = 0;
+                for (int k = 0; k < horizontal.taps; k++)
+                {
+                    const Pixel &p = source[index[k]];
+                    red += weight[k] * p.red;
+                    green += weight[k] * p.green;
+                    blue += weight[k] * p.blue;
+                }
+                target[col * 3] = red;
+                target[col * 3 + 1] = green;
+                target[col * 3 + 2] = blue;
+            }
+        }
+    });
+
+    // vertical pass: each output row is a weighted sum of whole resized rows, the inner loop runs straight along
+    // a row so the compiler can vectorize it
+    vector<vector<Pixel>> new_image = acquire_image(new_height, new_width);
+    parallel_rows(new_height, [&](int first_row, int end_row)
+    {
+        vector<float> sum(stride);
+        for (int row = first_row; row < end_row; ++row)
+        {
+            fill(sum.begin(), sum.end(), 0.0f);
+            for (int k = 0; k < vertical.taps; k++)
+            {
+                float w = vertical.weight[row * vertical.taps + k];
+                const float *source = &resized_rows[static_cast<size_t>(vertical.index[row * vertical.taps + k]) * stride];
+                for (int i = 0; i < stride; i++)
+                {
+                    sum[i] += w * source[i];
+                }
+            }
+
+            // bicubic and lanczos overshoot at hard edges, so clamp back into 0-255
+            vector<Pixel> &target = new_image[row];
+            for (int col = 0; col < new_width; ++col)
+            {
+                target[col].red = min(255, max(0, static_cast<int>(lround(sum[col * 3]))));
+                target[col].green = min(255, max(0, static_cast<int>(lround(sum[col * 3 + 1]))));
+                target[col].blue = min(255, max(0, static_cast<int>(lround(sum[col * 3 + 2]))));
+            }
+        }
+    });
+
+    return new_image;
+}
+
+// process 6: enlarge the image in the x and y direction
+vector<vector<Pixel>> process_6(const vector<vector<Pixel>> &image)
+{
+    double xscale, yscale;
+    int method;
+
+    prompt("enter the scaling factor for x (horizontal): ", xscale);
+    prompt("enter the scaling factor for y (vertical): ", yscale);
+    prompt("enter the resampling method (0 = nearest, 1 = bilinear, 2 = bicubic, 3 = lanczos): ", method);
+
+    if (method < RESAMPLE_NEAREST || method > RESAMPLE_LANCZOS)
+    {
+        cerr << "unknown resampling method, using nearest" << endl;
+        method = RESAMPLE_NEAREST;
+    }
+    return resample(image, xscale, yscale, method);
+}
+
+// helper function for process 7 and 12: pixels whose gray value is at least threshold turn white, the rest black
+void threshold_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &new_image, int threshold)
+{
+    int width = image[0].size();
+    int height = image.size();
+
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const Pixel *pixels = image[row].data();
+            Pixel *out = new_image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                int gray_value = (pixels[col].red + pixels[col].green + pixels[col].blue) / 3;
+
+                // where the high contrast magic is happening (no if/else so the compiler can vectorize it)
+                int value = gray_value >= threshold ? 255 : 0;
+                out[col] = {value, value, value};
+            }
+        }
+    });
+}
+
+// process 7: convert to high contrast
+vector<vector<Pixel>> process_7(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    threshold_into(image, new_image, 255 / 2);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_7(vector<vector<Pixel>> &&image)
+{
+    threshold_into(image, image, 255 / 2);
+    return move(image);
+}
+
+// helper function for process 8 and 13: moves every color value towards 255, a smaller scaling factor lightens more
+void lighten_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &new_image, double scaling_factor)
+{
+    int width = image[0].size();
+    int height = image.size();
+
+    for (int row = 0; row < height; ++row)
+    {
+        for (int col = 0; col < width; ++col)
+        {
+            const Pixel &p = image[row][col];
+            new_image[row][col] = {static_cast<int>(255 - (255 - p.red) * scaling_factor),
+                                   static_cast<int>(255 - (255 - p.green) * scaling_factor),
+                                   static_cast<int>(255 - (255 - p.blue) * scaling_factor)};
+        }
+    }
+}
+
+// process 8: lighten the image by a scaling factor
+const double PROCESS_8_FACTOR = 0.5; // change this to any desired value -- piazza post on scaling is wrong, have to guess and check to match the example picture
+
+vector<vector<Pixel>> process_8(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    lighten_into(image, new_image, PROCESS_8_FACTOR);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_8(vector<vector<Pixel>> &&image)
+{
+    lighten_into(image, image, PROCESS_8_FACTOR);
+    return move(image);
+}
+
+// helper function for process 9 and 13: scales every color value towards 0, a smaller scaling factor darkens more
+void darken_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &new_image, double scaling_factor)
+{
+    int width = image[0].size();
+    int height = image.size();
+
+    for (int row = 0; row < height; ++row)
+    {
+        for (int col = 0; col < width; ++col)
+        {
+            const Pixel &p = image[row][col];
+            new_image[row][col] = {static_cast<int>(p.red * scaling_factor), static_cast<int>(p.green * scaling_factor),
+                                   static_cast<int>(p.blue * scaling_factor)};
+        }
+    }
+}
+
+// process 9: darken the image by a scaling factor
+const double PROCESS_9_FACTOR = 0.5; // change this to any desired value, i changed to 0.5 because it was closest to the example picture (the piazza measurement is wrong)
+
+vector<vector<Pixel>> process_9(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    darken_into(image, new_image, PROCESS_9_FACTOR);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_9(vector<vector<Pixel>> &&image)
+{
+    darken_into(image, image, PROCESS_9_FACTOR);
+    return move(image);
+}
+
+// process 10: convert to black, white, red, blue, and green - the picture is really intense, hardly see green in the example
+// the color one pixel becomes, also used by the dithered version (process 23)
+Pixel process_10_pixel(const Pixel &current_pixel)
+{
+    Pixel new_pixel;
+
+    int red_value = current_pixel.red;
+    int green_value = current_pixel.green;
+    int blue_value = current_pixel.blue;
+    int max_color = max({red_value, green_value, blue_value});
+
+    if (red_value + green_value + blue_value >= 550)
+    {
+        // full white
+        new_pixel.red = 255;
+        new_pixel.green = 255;
+        new_pixel.blue = 255;
+    }
+    else if (red_value + green_value + blue_value <= 150)
+    {
+        // full dark
+        new_pixel.red = 0;
+        new_pixel.green = 0;
+        new_pixel.blue = 0;
+    }
+    else if (max_color == red_value)
+    {
+        // red
+        new_pixel.red = 255;
+        new_pixel.green = 0;
+        new_pixel.blue = 0;
+    }
+    else if (max_color == green_value)
+    {
+        // green
+        new_pixel.red = 0;
+        new_pixel.green = 255;
+        new_pixel.blue = 0;
+    }
+    else
+    {
+        // blue
+        new_pixel.red = 0;
+        new_pixel.green = 0;
+        new_pixel.blue = 255;
+    }
+
+    return new_pixel;
+}
+
+void process_10_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &processed_image)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+
+    for (int i = 0; i < num_rows; i++)
+    {
+        for (int j = 0; j < num_columns; j++)
+        {
+            processed_image[i][j] = process_10_pixel(image[i][j]);
+        }
+    }
+}
+
+vector<vector<Pixel>> process_10(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> processed_image = acquire_image(image.size(), image[0].size());
+    process_10_into(image, processed_image);
+    return processed_image;
+}
+
+vector<vector<Pixel>> process_10(vector<vector<Pixel>> &&image)
+{
+    process_10_into(image, image);
+    return move(image);
+}
+
+// process 11: turn image into sailormoon vaporwave pink
+void process_11_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &processed_image)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+
+    for (int i = 0; i < num_rows; i++)
+    {
+        for (int j = 0; j < num_columns; j++)
+        {
+            const Pixel &current_pixel = image[i][j];
+
+            // apply a cream pink tint, have to guess and check the severity
+            processed_image[i][j] = {min(255, static_cast<int>(current_pixel.red * 1.1 + 100)),
+                                     min(255, static_cast<int>(current_pixel.green * 0.8 + 70)),
+                                     min(255, static_cast<int>(current_pixel.blue * 0.8 + 70))};
+        }
+    }
+}
+
+vector<vector<Pixel>> process_11(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> processed_image = acquire_image(image.size(), image[0].size());
+    process_11_into(image, processed_image);
+    return processed_image;
+}
+
+vector<vector<Pixel>> process_11(vector<vector<Pixel>> &&image)
+{
+    process_11_into(image, image);
+    return move(image);
+}
+
+// how many pixels have each gray value (same (r + g + b) / 3 gray as process 3 and 7). every strip of rows counts into
+// its own histogram and they get added up at the end, so the threads never fight over the counts
+void luminance_histogram(const vector<vector<Pixel>> &image, long histogram[256])
+{
+    int width = image[0].size();
+    int height = image.size();
+    fill(histogram, histogram + 256, 0);
+    mutex merge_lock;
+
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        long local[256] = {0};
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const Pixel *pixels = image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                // values outside 0-255 (process 1 leaves some) count as 0 or 255
+                local[min(255, max(0, (pixels[col].red + pixels[col].green + pixels[col].blue) / 3))]++;
+            }
+        }
+        lock_guard<mutex> guard(merge_lock);
+        for (int i = 0; i < 256; i++)
+        {
+            histogram[i] += local[i];
+        }
+    });
+}
+
+// otsu's method: the gray value t that best splits the histogram into a dark group (<= t) and a light group (> t),
+// meaning the one where the two groups' averages are furthest apart (weighted by how big each group is)
+int otsu_threshold(const long histogram[256])
+{
+    double total = 0, total_sum = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        total += histogram[i];
+        total_sum += static_cast<double>(i) * histogram[i];
+    }
+
+    double dark_count = 0, dark_sum = 0;
+    double best_variance = -1;
+    // a single gray level (flat image) has no split at all, so fall back to the one process 7 uses (dark is below 127)
+    int best_threshold = 255 / 2 - 1;
+    for (int t = 0; t < 255; t++)
+    {
+        dark_count += histogram[t];
+        dark_sum += static_cast<double>(t) * histogram[t];
+        double light_count = total - dark_count;
+        if (dark_count == 0 || light_count == 0)
+        {
+            continue;
+        }
+        double dark_mean = dark_sum / dark_count;
+        double light_mean = (total_sum - dark_sum) / light_count;
+        double variance = dark_count * light_count * (dark_mean - light_mean) * (dark_mean - light_mean);
+        if (variance > best_variance)
+        {
+            best_variance = variance;
+            best_threshold = t;
+        }
+    }
+    return best_threshold;
+}
+
+// process 12: high contrast like process 7, but the threshold comes from the image (otsu) instead of always being 127,
+// so dark or washed out scans still split into text and background
+void process_12_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &new_image)
+{
+    long histogram[256];
+    luminance_histogram(image, histogram);
+    threshold_into(image, new_image, otsu_threshold(histogram) + 1);
+}
+
+vector<vector<Pixel>> process_12(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    process_12_into(image, new_image);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_12(vector<vector<Pixel>> &&image)
+{
+    process_12_into(image, image);
+    return move(image);
+}
+
+// histograms and summary numbers for an image. min/max/mean/variance are worked out from the histograms afterwards, so
+// the pass over the pixels only has to bump four counters per pixel
+struct ImageStats
+{
+    long pixels;
+    long histogram[4][256]; // red, green, blue, gray ((r + g + b) / 3 like process 3)
+    int min[4];
+    int max[4];
+    double mean[4];
+    double variance[4];
+};
+
+const char *STATS_CHANNEL_NAMES[4] = {"red", "green", "blue", "gray"};
+
+// one pass over the image split across cores, each strip counts into its own histograms which get added up at the end
+ImageStats image_stats(const vector<vector<Pixel>> &image)
+{
+    int width = image[0].size();
+    int height = image.size();
+    ImageStats stats = {};
+    stats.pixels = static_cast<long>(width) * height;
+    mutex merge_lock;
+
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        vector<long> local(4 * 256, 0); // too big for the thread's stack on some systems
+        long *red = &local[0], *green = &local[256], *blue = &local[512], *gray = &local[768];
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const Pixel *pixels = image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                // some filters (process 1) leave values outside 0-255, those count as 0 or 255
+                int r = min(255, max(0, pixels[col].red));
+                int g = min(255, max(0, pixels[col].green));
+                int b = min(255, max(0, pixels[col].blue));
+                red[r]++;
+                green[g]++;
+                blue[b]++;
+                gray[(r + g + b) / 3]++;
+            }
+        }
+        lock_guard<mutex> guard(merge_lock);
+        for (int channel = 0; channel < 4; channel++)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                stats.histogram[channel][i] += local[channel * 256 + i];
+            }
+        }
+    });
+
+    for (int channel = 0; channel < 4; channel++)
+    {
+        const long *histogram = stats.histogram[channel];
+        stats.min[channel] = 255;
+        stats.max[channel] = 0;
+        double sum = 0, sum_squares = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            if (histogram[i] > 0)
+            {
+                stats.min[channel] = min(stats.min[channel], i);
+                stats.max[channel] = max(stats.max[channel], i);
+            }
+            sum += static_cast<double>(i) * histogram[i];
+            sum_squares += static_cast<double>(i) * i * histogram[i];
+        }
+        stats.mean[channel] = stats.pixels > 0 ? sum / stats.pixels : 0;
+        stats.variance[channel] = stats.pixels > 0 ? sum_squares / stats.pixels - stats.mean[channel] * stats.mean[channel] : 0;
+    }
+    return stats;
+}
+
+// the stats as a JSON object, histograms included, for --image-stats
+string image_stats_json(const ImageStats &stats)
+{
+    stringstream out;
+    out << "{\"pixels\": " << stats.pixels;
+    for (int channel = 0; channel < 4; channel++)
+    {
+        out << ", \"" << STATS_CHANNEL_NAMES[channel] << "\": {\"min\": " << stats.min[channel] << ", \"max\": " << stats.max[channel]
+            << ", \"mean\": " << stats.mean[channel] << ", \"variance\": " << stats.variance[channel] << ", \"histogram\": [";
+        for (int i = 0; i < 256; i++)
+        {
+            out << (i == 0 ? "" : ",") << stats.histogram[channel][i];
+        }
+        out << "]}";
+    }
+    out << "}";
+    return out.str();
+}
+
+// one line per channel, for --image-stats on the screen
+void print_image_stats(const string &label, const ImageStats &stats)
+{
+    cout << label << ": " << stats.pixels << " pixels" << endl;
+    for (int channel = 0; channel < 4; channel++)
+    {
+        cout << "  " << STATS_CHANNEL_NAMES[channel] << ": min " << stats.min[channel] << ", max " << stats.max[channel]
+             << ", mean " << stats.mean[channel] << ", std dev " << sqrt(stats.variance[channel]) << endl;
+    }
+}
+
+// process 13: auto exposure, picks the process 8 (lighten) or process 9 (darken) scaling factor that brings the average
+// gray value to the middle (128) instead of always using 0.5
+void process_13_into(const vector<vector<Pixel>> &image, vector<vector<Pixel>> &new_image)
+{
+    const double TARGET_GRAY = 128;
+    // the factor that reaches the target is never below about 0.5 (127 / 255 or 128 / 255), so the limit has to sit above
+    // that to do anything. at 0.6 an all black image comes up to 102 instead of all the way to 128, a nearly black or white
+    // image pushed all the way just looks broken
+    const double STRONGEST_FACTOR = 0.6;
+    double mean_gray = image_stats(image).mean[3];
+
+    if (mean_gray < TARGET_GRAY)
+    {
+        // lighten: 255 - (255 - mean) * factor = target
+        lighten_into(image, new_image, max(STRONGEST_FACTOR, (255 - TARGET_GRAY) / (255 - mean_gray)));
+    }
+    else if (mean_gray > TARGET_GRAY)
+    {
+        // darken: mean * factor = target
+        darken_into(image, new_image, max(STRONGEST_FACTOR, TARGET_GRAY / mean_gray));
+    }
+    else if (&new_image != &image)
+    {
+        // already at the target, nothing to change
+        for (size_t row = 0; row < image.size(); ++row)
+        {
+            new_image[row] = image[row];
+        }
+    }
+}
+
+vector<vector<Pixel>> process_13(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    process_13_into(image, new_image);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_13(vector<vector<Pixel>> &&image)
+{
+    process_13_into(image, image);
+    return move(image);
+}
+
+// smallest value v where at least fraction of the pixels are <= v
+int histogram_percentile(const long histogram[256], long pixels, double fraction)
+{
+    long needed = static_cast<long>(ceil(fraction * pixels));
+    long seen = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        seen += histogram[i];
+        if (seen >= needed && seen > 0)
+        {
+            return i;
+        }
+    }
+    return 255;
+}
+
+// replaces every color value through a 256 entry table per channel, this is all the per pixel work process 14 does
+void apply_luts_in_place(vector<vector<Pixel>> &image, const int red_lut[256], const int green_lut[256], const int blue_lut[256])
+{
+    int width = image[0].size();
+    parallel_rows(image.size(), [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            Pixel *pixels = image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                // values outside 0-255 (process 1 leaves some) look up the 0 or 255 entry, like image_stats counts them
+                pixels[col].red = red_lut[min(255, max(0, pixels[col].red))];
+                pixels[col].green = green_lut[min(255, max(0, pixels[col].green))];
+                pixels[col].blue = blue_lut[min(255, max(0, pixels[col].blue))];
+            }
+        }
+    });
+}
+
+// process 14: auto levels, stretches each channel so its darkest 0.5% goes to 0 and its brightest 0.5% goes to 255
+// (ignoring the last half percent means one dead or hot pixel can't stop the stretch), which also takes out color casts
+void process_14_in_place(vector<vector<Pixel>> &image)
+{
+    const double CLIP = 0.005;
+    ImageStats stats = image_stats(image);
+    int luts[3][256];
+    for (int channel = 0; channel < 3; channel++)
+    {
+        int low = histogram_percentile(stats.histogram[channel], stats.pixels, CLIP);
+        int high = histogram_percentile(stats.histogram[channel], stats.pixels, 1 - CLIP);
+        for (int i = 0; i < 256; i++)
+        {
+            // a flat channel (high == low) is left alone
+            luts[channel][i] = high > low ? min(255, max(0, (i - low) * 255 / (high - low))) : i;
+        }
+    }
+    apply_luts_in_place(image, luts[0], luts[1], luts[2]);
+}
+
+vector<vector<Pixel>> process_14(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = copy_image(image);
+    process_14_in_place(new_image);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_14(vector<vector<Pixel>> &&image)
+{
+    process_14_in_place(image);
+    return move(image);
+}
+
+// process 15: histogram equalization on the gray value, so every brightness level ends up used about equally. only the
+// brightness moves (each pixel's channels all shift by how much its gray value moved), doing each channel on its own
+// would shift the colors
+void process_15_in_place(vector<vector<Pixel>> &image)
+{
+    ImageStats stats = image_stats(image);
+    const long *gray_histogram = stats.histogram[3];
+
+    // the usual mapping: cumulative count scaled to 0-255, starting from the first gray value that is actually used
+    int shift[256];
+    long first_count = 0;
+    for (int i = 0; i < 256 && first_count == 0; i++)
+    {
+        first_count = gray_histogram[i];
+    }
+    long cumulative = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        cumulative += gray_histogram[i];
+        int new_gray = stats.pixels > first_count ? static_cast<int>(lround(255.0 * (cumulative - first_count) / (stats.pixels - first_count))) : i;
+        shift[i] = max(0, new_gray) - i;
+    }
+
+    int width = image[0].size();
+    parallel_rows(image.size(), [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            Pixel *pixels = image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                // same clamped gray value image_stats counted the pixel under
+                int r = min(255, max(0, pixels[col].red));
+                int g = min(255, max(0, pixels[col].green));
+                int b = min(255, max(0, pixels[col].blue));
+                int delta = shift[(r + g + b) / 3];
+                pixels[col].red = min(255, max(0, r + delta));
+                pixels[col].green = min(255, max(0, g + delta));
+                pixels[col].blue = min(255, max(0, b + delta));
+            }
+        }
+    });
+}
+
+vector<vector<Pixel>> process_15(const vector<vector<Pixel>> &image)
+{
+    vector<vector<Pixel>> new_image = copy_image(image);
+    process_15_in_place(new_image);
+    return new_image;
+}
+
+vector<vector<Pixel>> process_15(vector<vector<Pixel>> &&image)
+{
+    process_15_in_place(image);
+    return move(image);
+}
+
+// the blur (and the filters built on it) work on a float copy of the image: red, green, blue next to each other, one row
+// after another, so a whole row is one run of floats the compiler can vectorize over
+struct FloatImage
+{
+    int width;
+    int height;
+    int stride; // floats per row, width * 3
+    vector<float> data;
+
+    float *row(int r) { return &data[static_cast<size_t>(r) * stride]; }
+    const float *row(int r) const { return &data[static_cast<size_t>(r) * stride]; }
+};
+
+FloatImage to_float_image(const vector<vector<Pixel>> &image)
+{
+    FloatImage result;
+    result.width = image[0].size();
+    result.height = image.size();
+    result.stride = result.width * 3;
+    result.data.resize(static_cast<size_t>(result.height) * result.stride);
+    parallel_rows(result.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            float *target = result.row(row);
+            const Pixel *pixels = image[row].data();
+            for (int col = 0; col < result.width; ++col)
+            {
+                target[col * 3] = pixels[col].red;
+                target[col * 3 + 1] = pixels[col].green;
+                target[col * 3 + 2] = pixels[col].blue;
+            }
+        }
+    });
+    return result;
+}
+
+// rounds back to whole numbers, clamped to 0-255, into an image of the same size
+void from_float_image(const FloatImage &source, vector<vector<Pixel>> &image)
+{
+    parallel_rows(source.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const float *values = source.row(row);
+            Pixel *pixels = image[row].data();
+            for (int col = 0; col < source.width; ++col)
+            {
+                pixels[col].red = min(255, max(0, static_cast<int>(values[col * 3] + 0.5f)));
+                pixels[col].green = min(255, max(0, static_cast<int>(values[col * 3 + 1] + 0.5f)));
+                pixels[col].blue = min(255, max(0, static_cast<int>(values[col * 3 + 2] + 0.5f)));
+            }
+        }
+    });
+}
+
+// copies one row into padded with `pad` pixels of the edge color repeated on both sides, so the horizontal passes can
+// run straight through without checking for the borders
+void pad_row(const float *row, int width, int pad, vector<float> &padded)
+{
+    padded.resize((width + 2 * pad) * 3);
+    for (int i = 0; i < pad; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            padded[i * 3 + c] = row[c];
+            padded[(pad + width + i) * 3 + c] = row[(width - 1) * 3 + c];
+        }
+    }
+    copy(row, row + width * 3, padded.begin() + pad * 3);
+}
+
+// gaussian weights out to 3 sigma each side (2 * radius + 1 of them), adding up to 1
+vector<float> gaussian_weights(double sigma)
+{
+    int radius = max(1, static_cast<int>(ceil(3 * sigma)));
+    vector<float> weights(2 * radius + 1);
+    double total = 0;
+    for (int k = -radius; k <= radius; k++)
+    {
+        weights[k + radius] = exp(-k * k / (2 * sigma * sigma));
+        total += weights[k + radius];
+    }
+    for (size_t k = 0; k < weights.size(); k++)
+    {
+        weights[k] /= total;
+    }
+    return weights;
+}
+
+// exact gaussian, one horizontal and one vertical pass with the same weights. good for small sigma, the cost grows with it
+void gaussian_blur(FloatImage &image, double sigma)
+{
+    vector<float> weights = gaussian_weights(sigma);
+    int radius = weights.size() / 2;
+
+    FloatImage temp = image;
+    // horizontal: image -> temp
+    parallel_rows(image.height, [&](int first_row, int end_row)
+    {
+        vector<float> padded;
+        for (int row = first_row; row < end_row; ++row)
+        {
+            pad_row(image.row(row), image.width, radius, padded);
+            float *target = temp.row(row);
+            fill(target, target + image.stride, 0.0f);
+            for (int k = 0; k <= 2 * radius; k++)
+            {
+                const float *source = &padded[k * 3];
+                for (int i = 0; i < image.stride; i++)
+                {
+                    target[i] += weights[k] * source[i];
+                }
+            }
+        }
+    });
+    // vertical: temp -> image, rows above and below the image repeat the edge row
+    parallel_rows(image.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            float *target = image.row(row);
+            fill(target, target + image.stride, 0.0f);
+            for (int k = -radius; k <= radius; k++)
+            {
+                const float *source = temp.row(min(image.height - 1, max(0, row + k)));
+                float w = weights[k + radius];
+                for (int i = 0; i < image.stride; i++)
+                {
+                    target[i] += w * source[i];
+                }
+            }
+        }
+    });
+}
+
+// one box blur pass each way with a running sum: add the pixel entering the window, take away the one leaving, so each
+// pixel costs the same no matter how big the radius is
+void box_blur(FloatImage &image, int radius)
+{
+    float scale = 1.0f / (2 * radius + 1);
+    FloatImage temp = image;
+
+    // horizontal: image -> temp, each row on its own
+    parallel_rows(image.height, [&](int first_row, int end_row)
+    {
+        vector<float> padded;
+        for (int row = first_row; row < end_row; ++row)
+        {
+            pad_row(image.row(row), image.width, radius + 1, padded);
+            float *target = temp.row(row);
+            float sum[3] = {0, 0, 0};
+            // window for column 0 covers padded columns 1 .. 2 * radius + 1
+            for (int i = 1; i <= 2 * radius + 1; i++)
+            {
+                for (int c = 0; c < 3; c++)
+                    sum[c] += padded[i * 3 + c];
+            }
+            for (int col = 0; col < image.width; ++col)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    target[col * 3 + c] = sum[c] * scale;
+                    sum[c] += padded[(col + 2 * radius + 2) * 3 + c] - padded[(col + 1) * 3 + c];
+                }
+            }
+        }
+    });
+
+    // vertical: temp -> image. the running sum goes down the rows, so the threads split the row up into column ranges
+    // instead (each thread keeps one running sum per float in its range)
+    parallel_rows(image.stride, [&](int first, int end)
+    {
+        vector<float> sum(end - first, 0.0f);
+        for (int k = -radius; k <= radius; k++)
+        {
+            const float *source = temp.row(min(image.height - 1, max(0, k)));
+            for (int i = first; i < end; i++)
+                sum[i - first] += source[i];
+        }
+        for (int row = 0; row < image.height; ++row)
+        {
+            float *target = image.row(row);
+            const float *entering = temp.row(min(image.height - 1, row + radius + 1));
+            const float *leaving = temp.row(max(0, row - radius));
+            for (int i = first; i < end; i++)
+            {
+                target[i] = sum[i - first] * scale;
+                sum[i - first] += entering[i] - leaving[i];
+            }
+        }
+    });
+}
+
+// gaussian blur where radius is the standard deviation in pixels. up to BLUR_EXACT_RADIUS it does the real gaussian, above
+// that three box blurs in a row, sized so the result matches the gaussian's spread (three boxes already look gaussian)
+const double BLUR_EXACT_RADIUS = 3;
+
+void blur_float_image(FloatImage &image, double radius)
+{
+    if (radius <= 0)
+    {
+        return;
+    }
+    if (radius <= BLUR_EXACT_RADIUS)
+    {
+        gaussian_blur(image, radius);
+        return;
+    }
+
+    // box widths for 3 passes that add up to the gaussian's variance (some passes one size up, some one size down)
+    const int PASSES = 3;
+    double ideal_width = sqrt(12 * radius * radius / PASSES + 1);
+    int lower = static_cast<int>(floor(ideal_width));
+    if (lower % 2 == 0)
+    {
+        lower--;
+    }
+    int upper = lower + 2;
+    int lower_passes = static_cast<int>(lround((12 * radius * radius - PASSES * lower * lower - 4 * PASSES * lower - 3 * PASSES) / (-4.0 * lower - 4)));
+    for (int pass = 0; pass < PASSES; pass++)
+    {
+        int width = pass < lower_passes ? lower : upper;
+        box_blur(image, (width - 1) / 2);
+    }
+}
+
+// helper function for process 16: blur without the prompt
+vector<vector<Pixel>> blur(const vector<vector<Pixel>> &image, double radius)
+{
+    FloatImage values = to_float_image(image);
+    blur_float_image(values, radius);
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    from_float_image(values, new_image);
+    return new_image;
+}
+
+// process 16: blur the image (soft focus / noise reduction)
+vector<vector<Pixel>> process_16(const vector<vector<Pixel>> &image)
+{
+    double radius;
+    prompt("enter the blur radius in pixels (for example 2): ", radius);
+    return blur(image, radius);
+}
+
+// convolution engine for neighbourhood filters: any square kernel (3x3, 5x5, 7x7...), split into a horizontal and a
+// vertical pass automatically when the kernel allows it
+enum BorderMode
+{
+    BORDER_CLAMP = 0,   // repeat the edge pixel
+    BORDER_REFLECT = 1, // mirror the image at the edge (..., 2, 1, 0 | 0, 1, 2, ...)
+    BORDER_WRAP = 2     // continue from the other side
+};
+
+struct Kernel
+{
+    int size;              // odd, size x size weights
+    vector<float> weights; // row by row
+    float bias;            // added to every result, 128 for kernels that add up to 0 (emboss) so flat areas come out gray
+};
+
+// where position p (which may be off either end of 0..length-1) reads from under the border mode. table[i] is for
+// p = i - pad, worked out once so the passes never check for the edges themselves
+vector<int> border_table(int length, int pad, int border)
+{
+    vector<int> table(length + 2 * pad);
+    for (int i = 0; i < static_cast<int>(table.size()); i++)
+    {
+        int p = i - pad;
+        if (border == BORDER_WRAP)
+        {
+            p = ((p % length) + length) % length;
+        }
+        else if (border == BORDER_REFLECT)
+        {
+            // loop for the tiny images where one reflection still lands outside
+            while (p < 0 || p >= length)
+            {
+                p = p < 0 ? -p - 1 : 2 * length - p - 1;
+            }
+        }
+        else
+        {
+            p = min(length - 1, max(0, p));
+        }
+        table[i] = p;
+    }
+    return table;
+}
+
+// copy of the image with pad extra pixels on the left and right filled in by the border mode. the middle of each row is
+// a straight copy, only the 2 * pad edge pixels go through the table
+FloatImage pad_columns(const FloatImage &image, int pad, int border)
+{
+    vector<int> columns = border_table(image.width, pad, border);
+    FloatImage padded;
+    padded.width = image.width + 2 * pad;
+    padded.height = image.height;
+    padded.stride = padded.width * 3;
+    padded.data.resize(static_cast<size_t>(padded.height) * padded.stride);
+    parallel_rows(image.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const float *source = image.row(row);
+            float *target = padded.row(row);
+            copy(source, source + image.stride, target + pad * 3);
+            for (int i = 0; i < pad; i++)
+            {
+                int right = padded.width - pad + i;
+                for (int c = 0; c < 3; c++)
+                {
+                    target[i * 3 + c] = source[columns[i] * 3 + c];
+                    target[right * 3 + c] = source[columns[right] * 3 + c];
+                }
+            }
+        }
+    });
+    return padded;
+}
+
+// if the kernel is an outer product (column x row), fills those two in and returns true. blur-like kernels usually are,
+// and then size + size multiplies per pixel do the work of size * size
+bool split_kernel(const Kernel &kernel, vector<float> &column, vector<float> &row)
+{
+    int n = kernel.size;
+    int pivot = 0;
+    for (int i = 1; i < n * n; i++)
+    {
+        if (fabs(kernel.weights[i]) > fabs(kernel.weights[pivot]))
+            pivot = i;
+    }
+    float pivot_value = kernel.weights[pivot];
+    if (pivot_value == 0)
+    {
+        return false;
+    }
+    int pivot_row = pivot / n, pivot_col = pivot % n;
+    column.resize(n);
+    row.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        column[i] = kernel.weights[i * n + pivot_col];
+        row[i] = kernel.weights[pivot_row * n + i] / pivot_value;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            if (fabs(column[i] * row[j] - kernel.weights[i * n + j]) > 1e-5f * fabs(pivot_value))
+                return false;
+        }
+    }
+    return true;
+}
+
+// columns handled per tile: the kernel's rows for one tile stay in cache while the tile moves down the strip
+const int CONVOLVE_TILE = 512;
+
+// out[i] += weight * source[i] for a run of floats, the loop every pass below is made of
+inline void add_weighted(float *out, const float *source, float weight, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] += weight * source[i];
+    }
+}
+
+// convolves image with kernel and returns the unrounded result (values can be below 0 or above 255)
+FloatImage convolve_float(const FloatImage &image, const Kernel &kernel, int border)
+{
+    int radius = kernel.size / 2;
+    FloatImage padded = pad_columns(image, radius, border);
+    vector<int> rows = border_table(image.height, radius, border); // rows[y + k] for k = 0 .. size - 1
+    FloatImage result;
+    result.width = image.width;
+    result.height = image.height;
+    result.stride = image.stride;
+    result.data.resize(image.data.size());
+
+    vector<float> column, row;
+    if (split_kernel(kernel, column, row))
+    {
+        // horizontal pass through the padded rows, then vertical through the row table
+        FloatImage temp = result;
+        parallel_rows(image.height, [&](int first_row, int end_row)
+        {
+            for (int y = first_row; y < end_row; ++y)
+            {
+                float *out = temp.row(y);
+                fill(out, out + image.stride, 0.0f);
+                for (int kx = 0; kx < kernel.size; kx++)
+                {
+                    add_weighted(out, padded.row(y) + kx * 3, row[kx], image.stride);
+                }
+            }
+        });
+        parallel_rows(image.height, [&](int first_row, int end_row)
+        {
+            for (int y = first_row; y < end_row; ++y)
+            {
+                float *out = result.row(y);
+                fill(out, out + image.stride, kernel.bias);
+                for (int ky = 0; ky < kernel.size; ky++)
+                {
+                    add_weighted(out, temp.row(rows[y + ky]), column[ky], image.stride);
+                }
+            }
+        });
+        return result;
+    }
+
+    parallel_rows(image.height, [&](int first_row, int end_row)
+    {
+        for (int tile = 0; tile < image.width; tile += CONVOLVE_TILE)
+        {
+            int count = min(CONVOLVE_TILE, image.width - tile) * 3;
+            for (int y = first_row; y < end_row; ++y)
+            {
+                float *out = result.row(y) + tile * 3;
+                fill(out, out + count, kernel.bias);
+                for (int ky = 0; ky < kernel.size; ky++)
+                {
+                    const float *source = padded.row(rows[y + ky]) + tile * 3;
+                    for (int kx = 0; kx < kernel.size; kx++)
+                    {
+                        float weight = kernel.weights[ky * kernel.size + kx];
+                        if (weight != 0)
+                        {
+                            add_weighted(out, source + kx * 3, weight, count);
+                        }
+                    }
+                }
+            }
+        }
+    });
+    return result;
+}
+
+// the same on a normal image, rounded and clamped back to 0-255
+vector<vector<Pixel>> convolve(const vector<vector<Pixel>> &image, const Kernel &kernel, int border = BORDER_CLAMP)
+{
+    FloatImage result = convolve_float(to_float_image(image), kernel, border);
+    vector<vector<Pixel>> new_image = acquire_image(image.size(), image[0].size());
+    from_float_image(result, new_image);
+    return new_image;
+}
+
+// process 17: emboss, makes the image look pressed into metal. brightness changes towards the bottom right come out
+// light, towards the top left dark, flat areas gray
+vector<vector<Pixel>> process_17(const vector<vector<Pixel>> &image)
+{
+    Kernel emboss = {3, {-1, -1, 0, -1, 0, 1, 0, 1, 1}, 128};
+    return convolve(image, emboss, BORDER_REFLECT);
+}
+
+// gray value of one row the same way process 3 works it out, with one extra pixel repeated on each side
+void gray_row(const vector<Pixel> &row, vector<int> &gray)
+{
+    int width = row.size();
+    for (int col = 0; col < width; ++col)
+    {
+        const Pixel &p = row[col];
+        gray[col + 1] = (p.red + p.green + p.blue) / 3;
+    }
+    gray[0] = gray[1];
+    gray[width + 1] = gray[width];
+}
+
+// process 18: edge detection. every pixel becomes the strength of the brightness change around it (sobel gradient
+// magnitude), white for sharp edges and black for flat areas. the gray version of the image is made a few rows at a
+// time inside the pass instead of as a whole image, and each row's gx, gy and magnitude are worked out together
+vector<vector<Pixel>> sobel_edges(const vector<vector<Pixel>> &image)
+{
+    int width = image[0].size();
+    int height = image.size();
+    vector<vector<Pixel>> new_image = acquire_image(height, width);
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        // gray rows above, at and below the current one (edges repeat the outermost row), rolled down as we go
+        vector<int> above(width + 2), middle(width + 2), below(width + 2);
+        vector<int> smooth(width + 2), diff(width + 2);
+        gray_row(image[max(0, first_row - 1)], above);
+        gray_row(image[first_row], middle);
+        for (int row = first_row; row < end_row; ++row)
+        {
+            gray_row(image[min(height - 1, row + 1)], below);
+            // the sobel kernels split into a vertical [1 2 1] or [-1 0 1] and a horizontal [-1 0 1] or [1 2 1]
+            for (int i = 0; i < width + 2; i++)
+            {
+                smooth[i] = above[i] + 2 * middle[i] + below[i];
+                diff[i] = below[i] - above[i];
+            }
+            vector<Pixel> &out = new_image[row];
+            for (int col = 0; col < width; ++col)
+            {
+                int gx = smooth[col + 2] - smooth[col];
+                int gy = diff[col] + 2 * diff[col + 1] + diff[col + 2];
+                int magnitude = min(255, static_cast<int>(sqrt(static_cast<float>(gx * gx + gy * gy)) + 0.5f));
+                out[col] = {magnitude, magnitude, magnitude};
+            }
+            swap(above, middle);
+            swap(middle, below);
+        }
+    });
+    return new_image;
+}
+
+vector<vector<Pixel>> process_18(const vector<vector<Pixel>> &image)
+{
+    return sobel_edges(image);
+}
+
+// unsharp mask: every channel moves away from its blurred value by amount times the difference, which brings out edges
+// and detail. differences smaller than threshold are left alone so flat areas and noise don't get grainy.
+// each strip keeps only the horizontally blurred rows the vertical pass still needs (2 * reach + 1 of them, reused in a
+// ring), so the blurred image never exists as a whole and the input is read once
+vector<vector<Pixel>> sharpen(const vector<vector<Pixel>> &image, double amount, double radius, int threshold)
+{
+    int width = image[0].size();
+    int height = image.size();
+    vector<float> weights = gaussian_weights(max(0.1, radius));
+    int reach = weights.size() / 2;
+    int ring_size = weights.size();
+    vector<vector<Pixel>> new_image = acquire_image(height, width);
+
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        vector<float> values(width * 3), padded, blurred(width * 3);
+        vector<vector<float>> ring(ring_size, vector<float>(width * 3));
+        // horizontal pass of source row r (rows above and below the image repeat the edge row) into its ring slot
+        auto blur_row = [&](int r)
+        {
+            const vector<Pixel> &row = image[min(height - 1, max(0, r))];
+            for (int col = 0; col < width; ++col)
+            {
+                values[col * 3] = row[col].red;
+                values[col * 3 + 1] = row[col].green;
+                values[col * 3 + 2] = row[col].blue;
+            }
+            pad_row(values.data(), width, reach, padded);
+            float *target = ring[((r % ring_size) + ring_size) % ring_size].data();
+            fill(target, target + width * 3, 0.0f);
+            for (int k = 0; k < ring_size; k++)
+            {
+                add_weighted(target, &padded[k * 3], weights[k], width * 3);
+            }
+        };
+        for (int r = first_row - reach; r < first_row + reach; r++)
+        {
+            blur_row(r);
+        }
+
+        for (int row = first_row; row < end_row; ++row)
+        {
+            blur_row(row + reach);
+            fill(blurred.begin(), blurred.end(), 0.0f);
+            for (int k = -reach; k <= reach; k++)
+            {
+                int r = row + k;
+                add_weighted(blurred.data(), ring[((r % ring_size) + ring_size) % ring_size].data(), weights[k + reach],
+                             width * 3);
+            }
+
+            const vector<Pixel> &source = image[row];
+            vector<Pixel> &out = new_image[row];
+            for (int col = 0; col < width; ++col)
+            {
+                int channels[3] = {source[col].red, source[col].green, source[col].blue};
+                for (int c = 0; c < 3; c++)
+                {
+                    float difference = channels[c] - blurred[col * 3 + c];
+                    if (fabs(difference) >= threshold)
+                    {
+                        channels[c] = min(255, max(0, static_cast<int>(floor(channels[c] + amount * difference + 0.5))));
+                    }
+                }
+                out[col] = {channels[0], channels[1], channels[2]};
+            }
+        }
+    });
+    return new_image;
+}
+
+// process 19: sharpen (unsharp mask)
+vector<vector<Pixel>> process_19(const vector<vector<Pixel>> &image)
+{
+    double amount, radius;
+    int threshold;
+    prompt("enter the sharpening amount (for example 1 for +100%): ", amount);
+    prompt("enter the sharpening radius in pixels (for example 1): ", radius);
+    prompt("enter the threshold, 0-255 (0 sharpens everything): ", threshold);
+    return sharpen(image, amount, radius, threshold);
+}
+
+// biggest radius median_filter takes, so a window ((2 * 127 + 1)^2 pixels) still fits the 16 bit histogram counts
+const int MAX_MEDIAN_RADIUS = 127;
+
+// median filter: every channel becomes the middle value of the (2 * radius + 1)^2 square around the pixel, which takes
+// out specks and scanner noise while keeping edges sharp. instead of sorting every window it keeps a 256 bin histogram per
+// column (updated by one pixel going out at the top and one coming in at the bottom each row) and a histogram for the
+// window (one column going out on the left and one coming in on the right each pixel). every histogram also has a 16 bin
+// coarse version so finding the middle value is 16 + 16 steps instead of up to 256. the cost per pixel doesn't depend on
+// the radius
+vector<vector<Pixel>> median_filter(const vector<vector<Pixel>> &image, int radius)
+{
+    int width = image[0].size();
+    int height = image.size();
+    radius = min(MAX_MEDIAN_RADIUS, max(0, radius));
+    int middle = (2 * radius + 1) * (2 * radius + 1) / 2; // rank of the median within the window
+    vector<vector<Pixel>> new_image = acquire_image(height, width);
+
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        // per column and channel: fine[(col * 3 + c) * 256 + value], coarse[(col * 3 + c) * 16 + value / 16]
+        vector<uint16_t> fine(static_cast<size_t>(width) * 3 * 256, 0), coarse(static_cast<size_t>(width) * 3 * 16, 0);
+        uint16_t window_fine[3 * 256], window_coarse[3 * 16];
+
+        // rows and columns past the edges repeat the edge pixel
+        auto add_row = [&](int r, uint16_t delta)
+        {
+            const vector<Pixel> &row = image[min(height - 1, max(0, r))];
+            for (int col = 0; col < width; ++col)
+            {
+                int values[3] = {row[col].red, row[col].green, row[col].blue};
+                for (int c = 0; c < 3; c++)
+                {
+                    fine[(col * 3 + c) * 256 + values[c]] += delta;
+                    coarse[(col * 3 + c) * 16 + values[c] / 16] += delta;
+                }
+            }
+        };
+        auto add_column = [&](int col, bool remove)
+        {
+            col = min(width - 1, max(0, col));
+            const uint16_t *column_fine = &fine[col * 3 * 256];
+            const uint16_t *column_coarse = &coarse[col * 3 * 16];
+            if (remove)
+            {
+                for (int i = 0; i < 3 * 256; i++)
+                    window_fine[i] -= column_fine[i];
+                for (int i = 0; i < 3 * 16; i++)
+                    window_coarse[i] -= column_coarse[i];
+            }
+            else
+            {
+                for (int i = 0; i < 3 * 256; i++)
+                    window_fine[i] += column_fine[i];
+                for (int i = 0; i < 3 * 16; i++)
+                    window_coarse[i] += column_coarse[i];
+            }
+        };
+        auto find_median = [&](int c)
+        {
+            const uint16_t *channel_coarse = &window_coarse[c * 16];
+            const uint16_t *channel_fine = &window_fine[c * 256];
+            int seen = 0, bin = 0;
+            while (seen + channel_coarse[bin] <= middle)
+            {
+                seen += channel_coarse[bin++];
+            }
+            int value = bin * 16;
+            while (seen + channel_fine[value] <= middle)
+            {
+                seen += channel_fine[value++];
+            }
+            return value;
+        };
+
+        for (int r = first_row - radius; r <= first_row + radius; r++)
+        {
+            add_row(r, 1);
+        }
+        for (int row = first_row; row < end_row; ++row)
+        {
+            if (row > first_row)
+            {
+                add_row(row - radius - 1, static_cast<uint16_t>(-1));
+                add_row(row + radius, 1);
+            }
+            fill(window_fine, window_fine + 3 * 256, 0);
+            fill(window_coarse, window_coarse + 3 * 16, 0);
+            for (int col = -radius; col <= radius; col++)
+            {
+                add_column(col, false);
+            }
+            vector<Pixel> &out = new_image[row];
+            for (int col = 0; col < width; ++col)
+            {
+                out[col] = {find_median(0), find_median(1), find_median(2)};
+                add_column(col + radius + 1, false);
+                add_column(col - radius, true);
+            }
+        }
+    });
+    return new_image;
+}
+
+// process 20: remove noise (median filter)
+vector<vector<Pixel>> process_20(const vector<vector<Pixel>> &image)
+{
+    int radius;
+    prompt("enter the median radius in pixels (for example 2): ", radius);
+    return median_filter(image, radius);
+}
+
+// black and white version of an image, one byte per pixel: 255 where the pixel is white (gray value from the middle up,
+// the same split as process 7), 0 where it is black
+struct Mask
+{
+    int width;
+    int height;
+    vector<uint8_t> data;
+
+    uint8_t *row(int r) { return &data[static_cast<size_t>(r) * width]; }
+    const uint8_t *row(int r) const { return &data[static_cast<size_t>(r) * width]; }
+};
+
+Mask to_mask(const vector<vector<Pixel>> &image)
+{
+    Mask mask;
+    mask.width = image[0].size();
+    mask.height = image.size();
+    mask.data.resize(static_cast<size_t>(mask.width) * mask.height);
+    parallel_rows(mask.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            uint8_t *bits = mask.row(row);
+            for (int col = 0; col < mask.width; ++col)
+            {
+                const Pixel &p = image[row][col];
+                bits[col] = (p.red + p.green + p.blue) / 3 >= 255 / 2 ? 255 : 0;
+            }
+        }
+    });
+    return mask;
+}
+
+void from_mask(const Mask &mask, vector<vector<Pixel>> &image)
+{
+    parallel_rows(mask.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            const uint8_t *bits = mask.row(row);
+            for (int col = 0; col < mask.width; ++col)
+            {
+                image[row][col] = {bits[col], bits[col], bits[col]};
+            }
+        }
+    });
+}
+
+enum MorphologyOperation
+{
+    MORPH_ERODE = 1,  // white areas shrink, white specks disappear
+    MORPH_DILATE = 2, // white areas grow, black specks and gaps disappear
+    MORPH_OPEN = 3,   // erode then dilate: removes white specks, keeps the size of everything else
+    MORPH_CLOSE = 4   // dilate then erode: fills black specks and gaps, keeps the size of everything else
+};
+
+inline uint8_t morph_combine(uint8_t a, uint8_t b, bool dilate)
+{
+    return dilate ? max(a, b) : min(a, b);
+}
+
+// van Herk/Gil-Werman running max (dilate) or min (erode) over windows of `size` values, along n values that are
+// `stride` apart, for `lanes` neighbouring lines at once (1 for a row, a run of columns for the vertical pass). the line is
+// cut into blocks of `size`, and every window covers the end of one block and the start of the next, so it is
+// the max of a suffix and a prefix that were both worked out in one sweep: 3 comparisons per value whatever the size.
+// values past the ends count as neither black nor white, so the edges of the image don't grow or shrink anything
+void van_herk_pass(const uint8_t *in, uint8_t *out, int n, int stride, int lanes, int size, bool dilate,
+                   vector<uint8_t> &prefix, vector<uint8_t> &suffix)
+{
+    int before = size / 2;
+    int padded = (n + size - 1 + size - 1) / size * size; // whole blocks covering the line plus both overhangs
+    uint8_t neutral = dilate ? 0 : 255;
+    prefix.resize(static_cast<size_t>(padded) * lanes);
+    suffix.resize(static_cast<size_t>(padded) * lanes);
+
+    for (int j = 0; j < padded; j++)
+    {
+        int i = j - before;
+        uint8_t *p = &prefix[static_cast<size_t>(j) * lanes];
+        uint8_t *s = &suffix[static_cast<size_t>(j) * lanes];
+        if (i < 0 || i >= n)
+        {
+            fill(p, p + lanes, neutral);
+        }
+        else
+        {
+            copy(in + static_cast<size_t>(i) * stride, in + static_cast<size_t>(i) * stride + lanes, p);
+        }
+        copy(p, p + lanes, s);
+        if (j % size != 0)
+        {
+            const uint8_t *previous = p - lanes;
+            for (int l = 0; l < lanes; l++)
+                p[l] = morph_combine(p[l], previous[l], dilate);
+        }
+    }
+    for (int j = padded - 1; j >= 0; j--)
+    {
+        if (j % size != size - 1)
+        {
+            uint8_t *s = &suffix[static_cast<size_t>(j) * lanes];
+            const uint8_t *next = s + lanes;
+            for (int l = 0; l < lanes; l++)
+                s[l] = morph_combine(s[l], next[l], dilate);
+        }
+    }
+    // the window for value x is padded positions x .. x + size - 1
+    for (int x = 0; x < n; x++)
+    {
+        const uint8_t *s = &suffix[static_cast<size_t>(x) * lanes];
+        const uint8_t *p = &prefix[static_cast<size_t>(x + size - 1) * lanes];
+        uint8_t *target = out + static_cast<size_t>(x) * stride;
+        for (int l = 0; l < lanes; l++)
+            target[l] = morph_combine(s[l], p[l], dilate);
+    }
+}
+
+// columns the vertical pass does together, enough to vectorise while the prefix and suffix buffers stay in cache
+const int MORPH_COLUMN_TILE = 256;
+
+// erodes or dilates the mask with a width x height rectangle, a horizontal pass and a vertical one
+void erode_or_dilate(Mask &mask, int width, int height, bool dilate)
+{
+    Mask temp = mask;
+    if (width > 1)
+    {
+        parallel_rows(mask.height, [&](int first_row, int end_row)
+        {
+            vector<uint8_t> prefix, suffix;
+            for (int row = first_row; row < end_row; ++row)
+            {
+                van_herk_pass(mask.row(row), temp.row(row), mask.width, 1, 1, width, dilate, prefix, suffix);
+            }
+        });
+    }
+    if (height > 1)
+    {
+        // columns are split between the threads, each thread goes down its columns a tile at a time
+        parallel_rows(mask.width, [&](int first_col, int end_col)
+        {
+            vector<uint8_t> prefix, suffix;
+            for (int col = first_col; col < end_col; col += MORPH_COLUMN_TILE)
+            {
+                int lanes = min(MORPH_COLUMN_TILE, end_col - col);
+                van_herk_pass(temp.row(0) + col, mask.row(0) + col, mask.height, mask.width, lanes, height, dilate, prefix,
+                              suffix);
+            }
+        });
+    }
+    else
+    {
+        mask.data.swap(temp.data);
+    }
+}
+
+void morphology(Mask &mask, int operation, int width, int height)
+{
+    width = max(1, width);
+    height = max(1, height);
+    if (operation == MORPH_ERODE || operation == MORPH_OPEN)
+        erode_or_dilate(mask, width, height, false);
+    if (operation != MORPH_ERODE)
+        erode_or_dilate(mask, width, height, true);
+    if (operation == MORPH_CLOSE)
+        erode_or_dilate(mask, width, height, false);
+}
+
+vector<vector<Pixel>> morphology(const vector<vector<Pixel>> &image, int operation, int width, int height)
+{
+    Mask mask = to_mask(image);
+    morphology(mask, operation, width, height);
+    vector<vector<Pixel>> new_image = acquire_image(mask.height, mask.width);
+    from_mask(mask, new_image);
+    return new_image;
+}
+
+// process 21: clean up a black and white image (for example the output of process 7). anything else gets split into
+// black and white first
+vector<vector<Pixel>> process_21(const vector<vector<Pixel>> &image)
+{
+    int operation, width, height;
+    prompt("enter 1 to erode, 2 to dilate, 3 to open (remove white specks), 4 to close (fill black specks): ", operation);
+    if (operation < MORPH_ERODE || operation > MORPH_CLOSE)
+    {
+        cerr << "error, " << operation << " is not one of the operations, leaving the image as it is" << endl;
+        return copy_image(image);
+    }
+    prompt("enter the width of the rectangle in pixels (for example 3): ", width);
+    prompt("enter the height of the rectangle in pixels (for example 3): ", height);
+    return morphology(image, operation, width, height);
+}
+
+// connected region of pixels that all have the same color, for example one letter in a process 7 output or one patch of
+// a process 10 color
+struct Component
+{
+    Pixel color;
+    int area;   // in pixels
+    int left;   // bounding box, inclusive
+    int top;
+    int right;
+    int bottom;
+};
+
+struct Components
+{
+    int width;
+    int height;
+    vector<int> labels; // component number of every pixel, row by row
+    vector<Component> components;
+};
+
+inline bool same_color(const Pixel &a, const Pixel &b)
+{
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+// union-find root of pixel i, halving the path on the way so later finds are shorter
+inline int find_root(vector<int> &parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// joins the sets of pixels a and b. the smaller pixel number becomes the root, so a component's root is its first pixel
+inline void join(vector<int> &parent, int a, int b)
+{
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+// splits the image into connected regions of one color (pixels touching left, right, above or below). every strip of
+// rows is labelled by its own thread with union-find, then the strips are joined along their first rows, then components
+// are numbered in the order their first pixel shows up (same numbers however many threads ran)
+Components connected_components(const vector<vector<Pixel>> &image)
+{
+    Components result;
+    int width = result.width = image[0].size();
+    int height = result.height = image.size();
+    vector<int> parent(static_cast<size_t>(width) * height);
+
+    // first row of every strip and how many components start in it, filled in as strips finish
+    vector<pair<int, int>> strips;
+    mutex strips_mutex;
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            for (int col = 0; col < width; ++col)
+            {
+                int i = row * width + col;
+                parent[i] = i;
+                if (col > 0 && same_color(image[row][col], image[row][col - 1]))
+                    join(parent, i, i - 1);
+                if (row > first_row && same_color(image[row][col], image[row - 1][col]))
+                    join(parent, i, i - width);
+            }
+        }
+        lock_guard<mutex> lock(strips_mutex);
+        strips.push_back(make_pair(first_row, 0));
+    });
+    sort(strips.begin(), strips.end());
+
+    // strips only meet along their first rows, joining those is a small serial step
+    for (size_t s = 1; s < strips.size(); s++)
+    {
+        int row = strips[s].first;
+        for (int col = 0; col < width; ++col)
+        {
+            if (same_color(image[row][col], image[row - 1][col]))
+                join(parent, row * width + col, (row - 1) * width + col);
+        }
+    }
+
+    // every pixel's root, read only so the strips can run side by side
+    vector<int> root(parent.size());
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        int roots = 0;
+        for (int i = first_row * width; i < end_row * width; i++)
+        {
+            int r = i;
+            while (parent[r] != r)
+                r = parent[r];
+            root[i] = r;
+            roots += r == i;
+        }
+        lock_guard<mutex> lock(strips_mutex);
+        lower_bound(strips.begin(), strips.end(), make_pair(first_row, 0))->second = roots;
+    });
+
+    // component numbers: each strip's roots count up from the number of roots in the strips above it. parent is done
+    // with, so its memory becomes the labels
+    vector<int> &labels = parent;
+    int total = 0;
+    for (size_t s = 0; s < strips.size(); s++)
+    {
+        int roots = strips[s].second;
+        strips[s].second = total;
+        total += roots;
+    }
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        int next = lower_bound(strips.begin(), strips.end(), make_pair(first_row, 0))->second;
+        for (int i = first_row * width; i < end_row * width; i++)
+        {
+            if (root[i] == i)
+                labels[i] = next++;
+        }
+    });
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int i = first_row * width; i < end_row * width; i++)
+        {
+            if (root[i] != i)
+                labels[i] = labels[root[i]];
+        }
+    });
+
+    result.components.resize(total);
+    for (int i = 0; i < total; i++)
+    {
+        result.components[i] = {Pixel(), 0, width, height, -1, -1};
+    }
+    for (int row = 0; row < height; ++row)
+    {
+        for (int col = 0; col < width; ++col)
+        {
+            Component &c = result.components[labels[row * width + col]];
+            if (c.area++ == 0)
+                c.color = image[row][col];
+            c.left = min(c.left, col);
+            c.right = max(c.right, col);
+            c.top = min(c.top, row);
+            c.bottom = max(c.bottom, row);
+        }
+    }
+    result.labels.swap(labels);
+    return result;
+}
+
+// every component in its own random color, so they can be told apart
+vector<vector<Pixel>> label_image(const Components &found)
+{
+    vector<vector<Pixel>> new_image = acquire_image(found.height, found.width);
+    parallel_rows(found.height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            for (int col = 0; col < found.width; ++col)
+            {
+                unsigned h = static_cast<unsigned>(found.labels[row * found.width + col]) * 2654435761u;
+                h ^= h >> 15;
+                new_image[row][col] = {static_cast<int>(h & 255), static_cast<int>((h >> 8) & 255),
+                                       static_cast<int>((h >> 16) & 255)};
+            }
+        }
+    });
+    return new_image;
+}
+
+// process 22: find connected regions. prints how many there are and the biggest ones, the output is label_image
+vector<vector<Pixel>> process_22(const vector<vector<Pixel>> &image)
+{
+    const int LARGEST_SHOWN = 10;
+    Components found = connected_components(image);
+    cout << "found " << found.components.size() << " connected region(s)" << endl;
+
+    vector<int> order(found.components.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    int shown = min(LARGEST_SHOWN, static_cast<int>(order.size()));
+    partial_sort(order.begin(), order.begin() + shown, order.end(), [&](int a, int b)
+    {
+        return found.components[a].area > found.components[b].area;
+    });
+    for (int i = 0; i < shown; i++)
+    {
+        const Component &c = found.components[order[i]];
+        cout << "  region " << order[i] << ": " << c.area << " pixels, color (" << c.color.red << ", " << c.color.green
+             << ", " << c.color.blue << "), box " << c.left << "," << c.top << " to " << c.right << "," << c.bottom << endl;
+    }
+
+    return label_image(found);
+}
+
+// where the error left over from one pixel goes: weight / divisor of it to the pixel dx, dy away
+struct DiffusionTap
+{
+    int dx;
+    int dy;
+    int weight;
+};
+
+struct DiffusionKernel
+{
+    vector<DiffusionTap> taps;
+    int divisor;
+    // how many columns the row above has to be ahead before a row can go on. enough that every error still coming into
+    // a pixel has arrived, and that two rows never write the same pixel at the same time
+    int lag;
+};
+
+const DiffusionKernel FLOYD_STEINBERG = {{{1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}}, 16, 3};
+// spreads only 6/8 of the error, so it keeps more contrast (and loses some detail in the darkest and lightest parts)
+const DiffusionKernel ATKINSON = {{{1, 0, 1}, {2, 0, 1}, {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}, {0, 2, 1}}, 8, 4};
+
+enum DitherColors
+{
+    DITHER_BLACK_AND_WHITE = 1, // the process 7 colors
+    DITHER_FIVE_COLORS = 2      // the process 10 colors
+};
+
+// error diffusion dithering: every pixel becomes the nearest allowed color like process 7 or 10 do, but what got lost is
+// passed on to the pixels not done yet, so areas keep their average brightness and color.
+// a pixel can only go once the pixels before it have passed their error on, so rows run as a wavefront: each thread takes
+// every num_threads-th row and stays kernel.lag columns behind the row above it. the errors are whole numbers, so the order
+// they arrive in doesn't matter and the result is exactly the same as doing it row by row on one thread
+vector<vector<Pixel>> dither(const vector<vector<Pixel>> &image, int colors, const DiffusionKernel &kernel)
+{
+    const int PUBLISH_EVERY = 16; // columns between progress updates, so rows below don't wait on every pixel
+    int width = image[0].size();
+    int height = image.size();
+    vector<vector<Pixel>> work = copy_image(image); // pixel values plus the error that has arrived so far
+    vector<atomic<int>> progress(height);           // columns finished in each row
+    for (int row = 0; row < height; ++row)
+    {
+        progress[row].store(0);
+    }
+
+    auto run_rows = [&](int first_row, int step)
+    {
+        TraceSpan span("dither rows " + to_string(first_row) + " + n*" + to_string(step), "strip");
+        for (int row = first_row; row < height; row += step)
+        {
+            int ready = row == 0 ? width : 0; // columns of the row above known to be finished
+            for (int col = 0; col < width; ++col)
+            {
+                int needed = min(width, col + kernel.lag);
+                while (ready < needed)
+                {
+                    ready = progress[row - 1].load(memory_order_acquire);
+                    if (ready < needed)
+                        this_thread::yield();
+                }
+
+                Pixel &p = work[row][col];
+                Pixel chosen;
+                int error[3];
+                if (colors == DITHER_BLACK_AND_WHITE)
+                {
+                    int gray_value = (p.red + p.green + p.blue) / 3;
+                    int value = gray_value >= 255 / 2 ? 255 : 0;
+                    chosen = {value, value, value};
+                    error[0] = error[1] = error[2] = gray_value - value;
+                }
+                else
+                {
+                    Pixel clamped = {min(255, max(0, p.red)), min(255, max(0, p.green)), min(255, max(0, p.blue))};
+                    chosen = process_10_pixel(clamped);
+                    error[0] = clamped.red - chosen.red;
+                    error[1] = clamped.green - chosen.green;
+                    error[2] = clamped.blue - chosen.blue;
+                }
+                p = chosen;
+
+                for (size_t t = 0; t < kernel.taps.size(); t++)
+                {
+                    const DiffusionTap &tap = kernel.taps[t];
+                    int x = col + tap.dx, y = row + tap.dy;
+                    if (x < 0 || x >= width || y >= height)
+                        continue;
+                    Pixel &q = work[y][x];
+                    q.red += error[0] * tap.weight / kernel.divisor;
+                    q.green += error[1] * tap.weight / kernel.divisor;
+                    q.blue += error[2] * tap.weight / kernel.divisor;
+                }
+                if ((col + 1) % PUBLISH_EVERY == 0 || col + 1 == width)
+                    progress[row].store(col + 1, memory_order_release);
+            }
+        }
+    };
+
+    int num_threads = thread::hardware_concurrency();
+    num_threads = max(1, min(num_threads, height));
+    vector<thread> workers;
+    for (int t = 1; t < num_threads; t++)
+    {
+        workers.push_back(thread(run_rows, t, num_threads));
+    }
+    run_rows(0, num_threads);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    return work;
+}
+
+// process 23: dither, a softer version of process 7 or 10
+vector<vector<Pixel>> process_23(const vector<vector<Pixel>> &image)
+{
+    int colors, method;
+    prompt("enter 1 for black and white (like process 7) or 2 for five colors (like process 10): ", colors);
+    if (colors != DITHER_BLACK_AND_WHITE && colors != DITHER_FIVE_COLORS)
+    {
+        cerr << "error, " << colors << " is not one of the color choices, leaving the image as it is" << endl;
+        return copy_image(image);
+    }
+    prompt("enter 1 for Floyd-Steinberg or 2 for Atkinson dithering: ", method);
+    if (method != 1 && method != 2)
+    {
+        cerr << "error, " << method << " is not one of the dithering methods, leaving the image as it is" << endl;
+        return copy_image(image);
+    }
+    return dither(image, colors, method == 2 ? ATKINSON : FLOYD_STEINBERG);
+}
+
+bool ends_with(const std::string &str, const std::string &suffix)
+{
+    if (str.size() < suffix.size())
+        return false;
+    return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
+}
+
+// 3D color lookup table: the output color for a size x size x size grid of input colors, anything in between is
+// interpolated. any smooth look that only depends on the pixel's own color (process 3, 11 or a .cube file from a color
+// grading program) becomes one of these
+struct Lut3D
+{
+    int size = 0;
+    vector<float> data;        // red, green, blue (0-255) of every grid point, red index changing fastest (as in .cube)
+    float domain_min[3] = {0, 0, 0}; // input range covered by the grid, 0-1 like in .cube files
+    float domain_max[3] = {1, 1, 1};
+
+    const float *at(int r, int g, int b) const { return &data[((static_cast<size_t>(b) * size + g) * size + r) * 3]; }
+};
+
+enum LutInterpolation
+{
+    LUT_TRILINEAR = 1,   // blends the 8 grid points around the color
+    LUT_TETRAHEDRAL = 2  // blends 4 of them, fewer multiplies and keeps grays gray
+};
+
+// reads an Adobe/Resolve .cube file (3D tables only). keywords it doesn't know are skipped, returns false with a message
+// on anything else it can't use
+bool read_cube_file(const string &filename, Lut3D &lut)
+{
+    ifstream file(filename);
+    if (!file.is_open())
+    {
+        cerr << "error, could not open " << filename << endl;
+        return false;
+    }
+    lut = Lut3D();
+    string line;
+    size_t values = 0;
+    while (getline(file, line))
+    {
+        istringstream words(line);
+        string first;
+        if (!(words >> first) || first[0] == '#')
+        {
+            continue;
+        }
+        if (first == "TITLE")
+        {
+            continue;
+        }
+        else if (first == "LUT_3D_SIZE")
+        {
+            words >> lut.size;
+            if (lut.size < 2 || lut.size > 256)
+            {
+                cerr << "error, " << filename << " has an unusable LUT_3D_SIZE" << endl;
+                return false;
+            }
+            lut.data.resize(static_cast<size_t>(lut.size) * lut.size * lut.size * 3);
+        }
+        else if (first == "DOMAIN_MIN" || first == "DOMAIN_MAX")
+        {
+            float *domain = first == "DOMAIN_MIN" ? lut.domain_min : lut.domain_max;
+            words >> domain[0] >> domain[1] >> domain[2];
+        }
+        else if (first == "LUT_3D_INPUT_RANGE")
+        {
+            // Resolve's older way of writing the domain, one min and max for all three channels
+            float low, high;
+            words >> low >> high;
+            fill(lut.domain_min, lut.domain_min + 3, low);
+            fill(lut.domain_max, lut.domain_max + 3, high);
+        }
+        else if (first == "LUT_1D_SIZE")
+        {
+            cerr << "error, " << filename << " is a 1D LUT, only 3D ones are supported" << endl;
+            return false;
+        }
+        else if (isalpha(static_cast<unsigned char>(first[0])))
+        {
+            continue; // some other keyword (LUT_1D_INPUT_RANGE, a program's own settings), data lines start with a number
+        }
+        else
+        {
+            float red, green, blue;
+            istringstream numbers(line);
+            if (lut.size == 0 || !(numbers >> red >> green >> blue) || values * 3 >= lut.data.size())
+            {
+                cerr << "error, unexpected line in " << filename << ": " << line << endl;
+                return false;
+            }
+            lut.data[values * 3] = red * 255;
+            lut.data[values * 3 + 1] = green * 255;
+            lut.data[values * 3 + 2] = blue * 255;
+            values++;
+        }
+    }
+    if (lut.size == 0 || values * 3 != lut.data.size())
+    {
+        cerr << "error, " << filename << " does not have size^3 entries" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool write_cube_file(const string &filename, const Lut3D &lut, const string &title)
+{
+    ofstream file(filename);
+    if (!file.is_open())
+    {
+        cerr << "error, could not write " << filename << endl;
+        return false;
+    }
+    file << "TITLE \"" << title << "\"" << endl;
+    file << "LUT_3D_SIZE " << lut.size << endl;
+    for (size_t i = 0; i < lut.data.size(); i += 3)
+    {
+        file << lut.data[i] / 255 << " " << lut.data[i + 1] / 255 << " " << lut.data[i + 2] / 255 << endl;
+    }
+    return true;
+}
+
+// bakes a filter into a LUT by running it on an image made of every grid color. only right for filters where a pixel's
+// output depends on nothing but its own color
+Lut3D lut_from_filter(const function<vector<vector<Pixel>>(const vector<vector<Pixel>> &)> &filter, int size)
+{
+    Lut3D lut;
+    lut.size = size;
+    lut.data.resize(static_cast<size_t>(size) * size * size * 3);
+    vector<vector<Pixel>> grid(size * size, vector<Pixel>(size));
+    for (int b = 0; b < size; b++)
+    {
+        for (int g = 0; g < size; g++)
+        {
+            for (int r = 0; r < size; r++)
+            {
+                // rounded, so the filter sees the nearest whole color to the grid point apply_lut interpolates from
+                grid[b * size + g][r] = {(r * 510 + size - 1) / (2 * (size - 1)), (g * 510 + size - 1) / (2 * (size - 1)),
+                                         (b * 510 + size - 1) / (2 * (size - 1))};
+            }
+        }
+    }
+    vector<vector<Pixel>> result = filter(grid);
+    for (int b = 0; b < size; b++)
+    {
+        for (int g = 0; g < size; g++)
+        {
+            for (int r = 0; r < size; r++)
+            {
+                const Pixel &p = result[b * size + g][r];
+                float *out = &lut.data[((static_cast<size_t>(b) * size + g) * size + r) * 3];
+                out[0] = p.red;
+                out[1] = p.green;
+                out[2] = p.blue;
+            }
+        }
+    }
+    return lut;
+}
+
+// the existing filters that can be baked into a LUT, or an empty function for the ones that can't. process 2, 7 and 10
+// only depend on the pixel's color too, but they jump at thresholds, and interpolating between grid points smears
+// those jumps into colors the filter never makes (gray for process 7), so they stay as they are
+function<vector<vector<Pixel>>(const vector<vector<Pixel>> &)> color_filter(int process)
+{
+    typedef vector<vector<Pixel>> (*Filter)(const vector<vector<Pixel>> &);
+    switch (process)
+    {
+    case 3:
+        return static_cast<Filter>(process_3);
+    case 11:
+        return static_cast<Filter>(process_11);
+    default:
+        return nullptr;
+    }
+}
+
+// runs every pixel through the LUT. input values are 0-255, so the grid cell and the position inside it are looked up
+// in a 256 entry table per channel instead of worked out per pixel
+void apply_lut_in_place(vector<vector<Pixel>> &image, const Lut3D &lut, int method)
+{
+    int width = image[0].size();
+    int height = image.size();
+    int cell[3][256];
+    float offset[3][256];
+    for (int c = 0; c < 3; c++)
+    {
+        for (int v = 0; v < 256; v++)
+        {
+            float x = (v / 255.0f - lut.domain_min[c]) / (lut.domain_max[c] - lut.domain_min[c]) * (lut.size - 1);
+            x = min(static_cast<float>(lut.size - 1), max(0.0f, x));
+            cell[c][v] = min(lut.size - 2, static_cast<int>(x));
+            offset[c][v] = x - cell[c][v];
+        }
+    }
+    // distance between neighbouring grid points in lut.data, in floats
+    const int step_r = 3, step_g = lut.size * 3, step_b = lut.size * lut.size * 3;
+
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            Pixel *pixels = image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                Pixel &p = pixels[col];
+                // the tables only cover 0-255, values outside (process 1 leaves some) count as 0 or 255
+                int red = min(255, max(0, p.red)), green = min(255, max(0, p.green)), blue = min(255, max(0, p.blue));
+                const float *c000 = lut.at(cell[0][red], cell[1][green], cell[2][blue]);
+                float fr = offset[0][red], fg = offset[1][green], fb = offset[2][blue];
+                float out[3];
+                if (method == LUT_TRILINEAR)
+                {
+                    for (int c = 0; c < 3; c++)
+                    {
+                        const float *q = c000 + c;
+                        float c00 = q[0] + fr * (q[step_r] - q[0]);
+                        float c10 = q[step_g] + fr * (q[step_g + step_r] - q[step_g]);
+                        float c01 = q[step_b] + fr * (q[step_b + step_r] - q[step_b]);
+                        float c11 = q[step_b + step_g] + fr * (q[step_b + step_g + step_r] - q[step_b + step_g]);
+                        float c0 = c00 + fg * (c10 - c00);
+                        float c1 = c01 + fg * (c11 - c01);
+                        out[c] = c0 + fb * (c1 - c0);
+                    }
+                }
+                else
+                {
+                    // the cube splits into 6 tetrahedra by which of fr, fg, fb is biggest. walk from the corner at 0,0,0
+                    // to the one at 1,1,1 along the edges in that order
+                    int first, second;
+                    float f1, f2, f3;
+                    if (fr > fg)
+                    {
+                        if (fg > fb)
+                        {
+                            first = step_r, second = step_r + step_g, f1 = fr, f2 = fg, f3 = fb;
+                        }
+                        else if (fr > fb)
+                        {
+                            first = step_r, second = step_r + step_b, f1 = fr, f2 = fb, f3 = fg;
+                        }
+                        else
+                        {
+                            first = step_b, second = step_b + step_r, f1 = fb, f2 = fr, f3 = fg;
+                        }
+                    }
+                    else
+                    {
+                        if (fb > fg)
+                        {
+                            first = step_b, second = step_b + step_g, f1 = fb, f2 = fg, f3 = fr;
+                        }
+                        else if (fb > fr)
+                        {
+                            first = step_g, second = step_g + step_b, f1 = fg, f2 = fb, f3 = fr;
+                        }
+                        else
+                        {
+                            first = step_g, second = step_g + step_r, f1 = fg, f2 = fr, f3 = fb;
+                        }
+                    }
+                    const int last = step_r + step_g + step_b;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        const float *q = c000 + c;
+                        out[c] = q[0] + f1 * (q[first] - q[0]) + f2 * (q[second] - q[first]) + f3 * (q[last] - q[second]);
+                    }
+                }
+                p.red = min(255, max(0, static_cast<int>(out[0] + 0.5f)));
+                p.green = min(255, max(0, static_cast<int>(out[1] + 0.5f)));
+                p.blue = min(255, max(0, static_cast<int>(out[2] + 0.5f)));
+            }
+        }
+    });
+}
+
+vector<vector<Pixel>> apply_lut(const vector<vector<Pixel>> &image, const Lut3D &lut, int method)
+{
+    vector<vector<Pixel>> new_image = copy_image(image);
+    apply_lut_in_place(new_image, lut, method);
+    return new_image;
+}
+
+// palette mapping: every pixel becomes the closest (straight line distance in red, green, blue) of up to 256 colors.
+// the color cube is cut into 32 x 32 x 32 cells, and every cell remembers the palette colors that can be the closest one
+// for some color inside it. most cells end up with one or two, so a pixel is a table lookup plus at most a handful of
+// comparisons instead of a search through the whole palette, and the result is exactly the closest color
+const int PALETTE_CELL_BITS = 5; // 32 cells per channel
+const int MAX_PALETTE_COLORS = 256;
+
+struct PaletteMap
+{
+    vector<Pixel> colors;
+    vector<int> first;             // candidates of cell i are candidates[first[i]] .. candidates[first[i + 1] - 1]
+    vector<uint8_t> candidates;    // palette indexes, lowest first so ties go to the earlier color
+};
+
+inline int color_distance(const Pixel &a, const Pixel &b)
+{
+    int dr = a.red - b.red, dg = a.green - b.green, db = a.blue - b.blue;
+    return dr * dr + dg * dg + db * db;
+}
+
+PaletteMap make_palette_map(const vector<Pixel> &colors)
+{
+    const int CELLS = 1 << PALETTE_CELL_BITS;
+    const int CELL_SIZE = 256 / CELLS;
+    PaletteMap map;
+    map.colors = colors;
+    int num_colors = min(MAX_PALETTE_COLORS, static_cast<int>(colors.size()));
+    map.colors.resize(num_colors);
+
+    // each blue slice of cells is worked out on its own, then the slices are put together in order
+    vector<vector<uint8_t>> slice_candidates(CELLS);
+    vector<vector<int>> slice_counts(CELLS, vector<int>(CELLS * CELLS));
+    parallel_rows(CELLS, [&](int first_slice, int end_slice)
+    {
+        vector<int> nearest(num_colors), farthest(num_colors);
+        for (int b = first_slice; b < end_slice; b++)
+        {
+            for (int g = 0; g < CELLS; g++)
+            {
+                for (int r = 0; r < CELLS; r++)
+                {
+                    // closest and farthest any color in the cell can be from each palette color
+                    int low[3] = {r * CELL_SIZE, g * CELL_SIZE, b * CELL_SIZE};
+                    int best_farthest = INT_MAX;
+                    for (int k = 0; k < num_colors; k++)
+                    {
+                        int values[3] = {map.colors[k].red, map.colors[k].green, map.colors[k].blue};
+                        nearest[k] = farthest[k] = 0;
+                        for (int c = 0; c < 3; c++)
+                        {
+                            int high = low[c] + CELL_SIZE - 1;
+                            int in = values[c] < low[c] ? low[c] - values[c] : values[c] > high ? values[c] - high : 0;
+                            int out = max(abs(values[c] - low[c]), abs(values[c] - high));
+                            nearest[k] += in * in;
+                            farthest[k] += out * out;
+                        }
+                        best_farthest = min(best_farthest, farthest[k]);
+                    }
+                    // a color that can't get closer than best_farthest always loses to the color that set it
+                    int count = 0;
+                    for (int k = 0; k < num_colors; k++)
+                    {
+                        if (nearest[k] <= best_farthest)
+                        {
+                            slice_candidates[b].push_back(k);
+                            count++;
+                        }
+                    }
+                    slice_counts[b][g * CELLS + r] = count;
+                }
+            }
+        }
+    });
+
+    map.first.resize(CELLS * CELLS * CELLS + 1);
+    int total = 0;
+    for (int b = 0; b < CELLS; b++)
+    {
+        for (int i = 0; i < CELLS * CELLS; i++)
+        {
+            map.first[b * CELLS * CELLS + i] = total;
+            total += slice_counts[b][i];
+        }
+        map.candidates.insert(map.candidates.end(), slice_candidates[b].begin(), slice_candidates[b].end());
+    }
+    map.first[CELLS * CELLS * CELLS] = total;
+    return map;
+}
+
+// index of the palette color closest to p (channels outside 0-255 count as 0 or 255, the cells only cover that range)
+inline int nearest_palette_color(const PaletteMap &map, const Pixel &pixel)
+{
+    const int SHIFT = 8 - PALETTE_CELL_BITS;
+    Pixel p = {min(255, max(0, pixel.red)), min(255, max(0, pixel.green)), min(255, max(0, pixel.blue))};
+    int cell = (((p.blue >> SHIFT) << PALETTE_CELL_BITS | (p.green >> SHIFT)) << PALETTE_CELL_BITS) | (p.red >> SHIFT);
+    int first = map.first[cell], end = map.first[cell + 1];
+    int best = map.candidates[first];
+    if (end - first > 1)
+    {
+        int best_distance = color_distance(p, map.colors[best]);
+        for (int i = first + 1; i < end; i++)
+        {
+            int distance = color_distance(p, map.colors[map.candidates[i]]);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = map.candidates[i];
+            }
+        }
+    }
+    return best;
+}
+
+void apply_palette_in_place(vector<vector<Pixel>> &image, const PaletteMap &map)
+{
+    int width = image[0].size();
+    int height = image.size();
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            Pixel *pixels = image[row].data();
+            for (int col = 0; col < width; ++col)
+            {
+                pixels[col] = map.colors[nearest_palette_color(map, pixels[col])];
+            }
+        }
+    });
+}
+
+vector<vector<Pixel>> apply_palette(const vector<vector<Pixel>> &image, const PaletteMap &map)
+{
+    vector<vector<Pixel>> new_image = copy_image(image);
+    apply_palette_in_place(new_image, map);
+    return new_image;
+}
+
+// the built in palettes: "web" (the 216 web safe colors), "gray" (16 grays) and "five" (the process 10 colors). anything
+// else is a text file with one "red green blue" color per line. returns an empty palette when there is nothing usable
+vector<Pixel> load_palette(const string &name)
+{
+    vector<Pixel> colors;
+    if (name == "web")
+    {
+        for (int b = 0; b < 6; b++)
+            for (int g = 0; g < 6; g++)
+                for (int r = 0; r < 6; r++)
+                    colors.push_back({r * 51, g * 51, b * 51});
+        return colors;
+    }
+    if (name == "gray")
+    {
+        for (int i = 0; i < 16; i++)
+            colors.push_back({i * 17, i * 17, i * 17});
+        return colors;
+    }
+    if (name == "five")
+    {
+        return {{0, 0, 0}, {255, 255, 255}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+    }
+
+    ifstream file(name);
+    if (!file.is_open())
+    {
+        cerr << "error, could not open palette " << name << endl;
+        return colors;
+    }
+    string line;
+    while (getline(file, line))
+    {
+        istringstream numbers(line);
+        int red, green, blue;
+        if (line.empty() || line[0] == '#' || !(numbers >> red >> green >> blue))
+        {
+            continue;
+        }
+        colors.push_back({min(255, max(0, red)), min(255, max(0, green)), min(255, max(0, blue))});
+    }
+    if (static_cast<int>(colors.size()) > MAX_PALETTE_COLORS)
+    {
+        cerr << "palette " << name << " has " << colors.size() << " colors, using the first " << MAX_PALETTE_COLORS << endl;
+        colors.resize(MAX_PALETTE_COLORS);
+    }
+    return colors;
+}
+
+// process 25: reduce the image to a palette
+vector<vector<Pixel>> process_25(const vector<vector<Pixel>> &image)
+{
+    string name;
+    prompt("enter a palette file (one \"red green blue\" per line), or web, gray or five for a built in one: ", name);
+    vector<Pixel> colors = load_palette(name);
+    if (colors.empty())
+    {
+        cerr << "error, no colors in palette " << name << ", leaving the image as it is" << endl;
+        return copy_image(image);
+    }
+    return apply_palette(image, make_palette_map(colors));
+}
+
+// grid size used when a filter is baked into a LUT, the usual size for .cube files
+const int DEFAULT_LUT_SIZE = 33;
+
+// process 24: apply a color look from a .cube file (or one of the color filters turned into a LUT)
+vector<vector<Pixel>> process_24(const vector<vector<Pixel>> &image)
+{
+    string source;
+    int method;
+    prompt("enter a .cube file, or 3 or 11 to use that process as a LUT: ", source);
+    prompt("enter 1 for trilinear or 2 for tetrahedral interpolation: ", method);
+    if (method != LUT_TRILINEAR && method != LUT_TETRAHEDRAL)
+    {
+        cerr << "error, " << method << " is not one of the interpolation choices, leaving the image as it is" << endl;
+        return copy_image(image);
+    }
+    Lut3D lut;
+    if (ends_with(source, ".cube"))
+    {
+        if (!read_cube_file(source, lut))
+        {
+            return copy_image(image);
+        }
+    }
+    else if (color_filter(atoi(source.c_str())))
+    {
+        lut = lut_from_filter(color_filter(atoi(source.c_str())), DEFAULT_LUT_SIZE);
+    }
+    else
+    {
+        cerr << "error, " << source << " is not a .cube file or a color filter, leaving the image as it is" << endl;
+        return copy_image(image);
+    }
+    return apply_lut(image, lut, method);
+}
+
+// --make-lut: writes the LUT for one of the color filters, for use in other programs or to edit as a starting point
+bool make_lut_file(int process, const string &filename, int size)
+{
+    if (!color_filter(process))
+    {
+        cerr << "error, process " << process << " can't be made into a LUT (3 or 11 can)" << endl;
+        return false;
+    }
+    if (size < 2 || size > 256)
+    {
+        cerr << "error, LUT size must be 2-256" << endl;
+        return false;
+    }
+    return write_cube_file(filename, lut_from_filter(color_filter(process), size), "process " + to_string(process));
+}
+
+// patterns for generated test images (--generate and the benchmarks)
+enum TestPattern
+{
+    PATTERN_MIX,      // gradients plus noise, what the benchmarks use
+    PATTERN_GRADIENT, // smooth ramps, red across, green down, blue diagonal
+    PATTERN_NOISE,    // every channel random
+    PATTERN_CHECKER,  // squares cycling through white, black, red, green and blue-ish colours
+    PATTERN_PHOTO     // smooth blotches of colour at a few scales plus grain, like a photo
+};
+
+const char *PATTERN_NAMES[] = {"mix", "gradient", "noise", "checker", "photo"};
+const int NUM_PATTERNS = 5;
+
+// same (x, y, seed) always gives the same number, so any row can be generated on its own
+unsigned hash_pixel(unsigned x, unsigned y, unsigned seed)
+{
+    unsigned h = x * 374761393u + y * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+// smooth random value 0-255 at (x, y): random values on a grid cell_size apart, blended in between
+int value_noise(int x, int y, int cell_size, unsigned seed)
+{
+    int cx = x / cell_size;
+    int cy = y / cell_size;
+    double fx = static_cast<double>(x % cell_size) / cell_size;
+    double fy = static_cast<double>(y % cell_size) / cell_size;
+    // smoothstep so the grid doesn't show
+    fx = fx * fx * (3 - 2 * fx);
+    fy = fy * fy * (3 - 2 * fy);
+    double top = (hash_pixel(cx, cy, seed) & 255) * (1 - fx) + (hash_pixel(cx + 1, cy, seed) & 255) * fx;
+    double bottom = (hash_pixel(cx, cy + 1, seed) & 255) * (1 - fx) + (hash_pixel(cx + 1, cy + 1, seed) & 255) * fx;
+    return static_cast<int>(top * (1 - fy) + bottom * fy);
+}
+
+// fills pixels with row `row` of a width x height image in the given pattern
+void generate_row(int pattern, int row, int width, int height, unsigned seed, vector<Pixel> &pixels)
+{
+    pixels.resize(width);
+    int cell_size = max(8, min(width, height) / 16); // checker squares and photo blotches scale with the image
+    for (int col = 0; col < width; ++col)
+    {
+        unsigned random = hash_pixel(col, row, seed);
+        Pixel &p = pixels[col];
+        if (pattern == PATTERN_GRADIENT)
+        {
+            p.red = static_cast<int>(255LL * col / max(1, width - 1));
+            p.green = static_cast<int>(255LL * row / max(1, height - 1));
+            p.blue = static_cast<int>(255LL * (col + row) / max(1, width + height - 2));
+        }
+        else if (pattern == PATTERN_NOISE)
+        {
+            p.red = random & 255;
+            p.green = (random >> 8) & 255;
+            p.blue = (random >> 16) & 255;
+        }
+        else if (pattern == PATTERN_CHECKER)
+        {
+            // one square each of: white, black, mostly red, mostly green, mostly blue (the five process 10 colours)
+            const Pixel colours[] = {{240, 235, 230}, {20, 25, 30}, {200, 60, 50}, {50, 190, 70}, {40, 60, 210}};
+            p = colours[(col / cell_size + row / cell_size) % 5];
+        }
+        else if (pattern == PATTERN_PHOTO)
+        {
+            // brightness from big blotches, colour from medium ones, then a little grain on top. this lands in the dark,
+            // middle and bright ranges of process 2 and gives every channel a turn at being the biggest
+            int brightness = value_noise(col, row, cell_size * 4, seed) - 128;
+            int grain = static_cast<int>(random % 17) - 8;
+            p.red = min(255, max(0, value_noise(col, row, cell_size, seed + 1) + brightness + grain));
+            p.green = min(255, max(0, value_noise(col, row, cell_size, seed + 2) + brightness + grain));
+            p.blue = min(255, max(0, value_noise(col, row, cell_size, seed + 3) + brightness + grain));
+        }
+        else
+        {
+            int noise = (random >> 24) % 64;
+            p.red = static_cast<int>((255LL * col / max(1, width - 1) + noise) % 256);
+            p.green = static_cast<int>((255LL * row / max(1, height - 1) + noise) % 256);
+            p.blue = static_cast<int>((255LL * (col + row) / max(1, width + height - 2) + 2 * noise) % 256);
+        }
+    }
+}
+
+// builds a width x height test image in memory, so the filters with branches (2, 7, 10) go down all of them instead of
+// always taking the same one. same seed, same image
+vector<vector<Pixel>> make_test_image(int width, int height, int pattern = PATTERN_MIX, unsigned seed = 1)
+{
+    vector<vector<Pixel>> image(height);
+    for (int row = 0; row < height; ++row)
+    {
+        generate_row(pattern, row, width, height, seed, image[row]);
+    }
+    return image;
+}
+
+// --generate: writes a generated image straight to a BMP one row at a time, so a 100 megapixel file doesn't need the
+// whole image in memory. the file is the same 24 bit format write_image produces. also counts which process 2 branch
+// and process 10 colour every pixel would take, to show the image actually covers them
+bool generate_image_file(const string &filename, int width, int height, int pattern, unsigned seed)
+{
+    if (width <= 0 || height <= 0)
+    {
+        cerr << "error, " << width << "x" << height << " is not a valid image size" << endl;
+        return false;
+    }
+    // widths near INT_MAX would overflow int here, so the row size is worked out in long long
+    long long padding_bytes = (4 - static_cast<long long>(width) * 3 % 4) % 4;
+    long long array_bytes = (static_cast<long long>(width) * 3 + padding_bytes) * height;
+    if (54 + array_bytes > 0x7fffffffLL)
+    {
+        cerr << "error, " << width << "x" << height << " does not fit in a BMP file" << endl;
+        return false;
+    }
+
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    // same headers as write_image
+    const int BMP_HEADER_SIZE = 14;
+    const int DIB_HEADER_SIZE = 40;
+    unsigned char bmp_header[BMP_HEADER_SIZE] = {0};
+    unsigned char dib_header[DIB_HEADER_SIZE] = {0};
+    set_bytes(bmp_header, 0, 1, 'B');
+    set_bytes(bmp_header, 1, 1, 'M');
+    set_bytes(bmp_header, 2, 4, BMP_HEADER_SIZE + DIB_HEADER_SIZE + static_cast<int>(array_bytes));
+    set_bytes(bmp_header, 10, 4, BMP_HEADER_SIZE + DIB_HEADER_SIZE);
+    set_bytes(dib_header, 0, 4, DIB_HEADER_SIZE);
+    set_bytes(dib_header, 4, 4, width);
+    set_bytes(dib_header, 8, 4, height);
+    set_bytes(dib_header, 12, 2, 1);
+    set_bytes(dib_header, 14, 2, 24);
+    set_bytes(dib_header, 20, 4, static_cast<int>(array_bytes));
+    set_bytes(dib_header, 24, 4, 2835);
+    set_bytes(dib_header, 28, 4, 2835);
+    stream.write((char *)bmp_header, sizeof(bmp_header));
+    stream.write((char *)dib_header, sizeof(dib_header));
+
+    long long process_2_branches[3] = {0}; // dark, middle, bright
+    long long process_10_colours[5] = {0}; // white, black, red, green, blue
+    vector<Pixel> pixels;
+    vector<unsigned char> bytes(static_cast<size_t>(width) * 3 + padding_bytes, 0);
+    // BMP rows go bottom to top
+    for (int row = height - 1; row >= 0; row--)
+    {
+        generate_row(pattern, row, width, height, seed, pixels);
+        for (int col = 0; col < width; ++col)
+        {
+            const Pixel &p = pixels[col];
+            bytes[col * 3] = p.blue;
+            bytes[col * 3 + 1] = p.green;
+            bytes[col * 3 + 2] = p.red;
+
+            int sum = p.red + p.green + p.blue;
+            process_2_branches[sum >= 510 ? 2 : (sum < 270 ? 0 : 1)]++; // average >= 170, average < 90
+            int max_color = max({p.red, p.green, p.blue});
+            process_10_colours[sum >= 550 ? 0 : (sum <= 150 ? 1 : (max_color == p.red ? 2 : (max_color == p.green ? 3 : 4)))]++;
+        }
+        stream.write((char *)bytes.data(), bytes.size());
+    }
+    stream.close();
+
+    cout << "wrote " << filename << ": " << width << "x" << height << " " << PATTERN_NAMES[pattern] << ", seed " << seed << endl;
+    cout << "  process_2 branches (dark / middle / bright): " << process_2_branches[0] << " / " << process_2_branches[1]
+         << " / " << process_2_branches[2] << endl;
+    cout << "  process_10 colours (white / black / red / green / blue): " << process_10_colours[0] << " / "
+         << process_10_colours[1] << " / " << process_10_colours[2] << " / " << process_10_colours[3] << " / "
+         << process_10_colours[4] << endl;
+    return true;
+}
+
+// bits per pixel for write_bmp. BMP_BITS_AUTO picks the smallest one that holds every color in the image
+const int BMP_BITS_AUTO = 0;
+
+// one int per color for sorting and looking up palette entries. each channel is first brought into 0-255 the way
+// write_image stores it (the low byte, so -1 is 255), which keeps 8 and 1 bit files the same as the 24 bit one even for
+// filters that leave values out of range (process 1), and keeps the shifts away from negative numbers
+inline int color_key(const Pixel &p)
+{
+    return (p.red & 255) << 16 | (p.green & 255) << 8 | (p.blue & 255);
+}
+
+// the distinct colors of the image, sorted (for a gray image that is dark to light), or nothing if there are more than
+// max_colors. a photo gives up after a few rows, so checking costs little when the answer is 24 bits
+vector<Pixel> image_palette(const vector<vector<Pixel>> &image, int max_colors)
+{
+    vector<int> keys; // red << 16 | green << 8 | blue, sorted
+    int last = -1;
+    for (size_t row = 0; row < image.size(); ++row)
+    {
+        for (size_t col = 0; col < image[row].size(); ++col)
+        {
+            const Pixel &p = image[row][col];
+            int key = color_key(p);
+            if (key == last)
+                continue;
+            last = key;
+            vector<int>::iterator at = lower_bound(keys.begin(), keys.end(), key);
+            if (at == keys.end() || *at != key)
+            {
+                if (static_cast<int>(keys.size()) == max_colors)
+                    return vector<Pixel>();
+                keys.insert(at, key);
+            }
+        }
+    }
+    vector<Pixel> palette;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        palette.push_back({keys[i] >> 16, (keys[i] >> 8) & 255, keys[i] & 255});
+    }
+    return palette;
+}
+
+// writes the image as a BMP with 24, 8 (up to 256 colors, through a palette) or 1 (two colors) bits per pixel. gray
+// results come out a third of the size of write_image's and black and white ones 1/24th. asking for fewer bits than the
+// image needs falls back to the smallest size that fits. 24 bits is write_image itself
+bool write_bmp(const string &filename, const vector<vector<Pixel>> &image, int bits = BMP_BITS_AUTO)
+{
+    vector<Pixel> palette;
+    if (bits != 24)
+    {
+        palette = image_palette(image, 256);
+        int needed = palette.empty() ? 24 : (palette.size() <= 2 ? 1 : 8);
+        if (bits != BMP_BITS_AUTO && needed > bits)
+        {
+            cerr << "the image has too many colors for " << bits << " bits per pixel, using " << needed << endl;
+        }
+        bits = bits == BMP_BITS_AUTO ? needed : max(bits, needed);
+    }
+    if (bits == 24)
+    {
+        return write_image(filename, image);
+    }
+
+    int width = image[0].size();
+    int height = image.size();
+    if (palette.size() < 2)
+    {
+        palette.resize(2, palette[0]); // a 1 bit file always has two palette entries
+    }
+    int row_bytes = (width * bits + 31) / 32 * 4;
+    vector<unsigned char> pixel_array(static_cast<size_t>(row_bytes) * height, 0);
+    vector<int> keys;
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        keys.push_back(color_key(palette[i]));
+    }
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            // BMP rows go bottom to top
+            unsigned char *bytes = &pixel_array[static_cast<size_t>(height - 1 - row) * row_bytes];
+            int last = -1, index = 0;
+            for (int col = 0; col < width; ++col)
+            {
+                const Pixel &p = image[row][col];
+                int key = color_key(p);
+                if (key != last)
+                {
+                    last = key;
+                    index = lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+                }
+                if (bits == 8)
+                    bytes[col] = index;
+                else
+                    bytes[col / 8] |= index << (7 - col % 8);
+            }
+        }
+    });
+
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    // same headers as write_image, plus the palette (blue, green, red, 0 per color) between them and the pixels
+    const int BMP_HEADER_SIZE = 14;
+    const int DIB_HEADER_SIZE = 40;
+    int palette_bytes = palette.size() * 4;
+    unsigned char bmp_header[BMP_HEADER_SIZE] = {0};
+    unsigned char dib_header[DIB_HEADER_SIZE] = {0};
+    set_bytes(bmp_header, 0, 1, 'B');
+    set_bytes(bmp_header, 1, 1, 'M');
+    set_bytes(bmp_header, 2, 4, BMP_HEADER_SIZE + DIB_HEADER_SIZE + palette_bytes + static_cast<int>(pixel_array.size()));
+    set_bytes(bmp_header, 10, 4, BMP_HEADER_SIZE + DIB_HEADER_SIZE + palette_bytes);
+    set_bytes(dib_header, 0, 4, DIB_HEADER_SIZE);
+    set_bytes(dib_header, 4, 4, width);
+    set_bytes(dib_header, 8, 4, height);
+    set_bytes(dib_header, 12, 2, 1);
+    set_bytes(dib_header, 14, 2, bits);
+    set_bytes(dib_header, 20, 4, static_cast<int>(pixel_array.size()));
+    set_bytes(dib_header, 24, 4, 2835);
+    set_bytes(dib_header, 28, 4, 2835);
+    set_bytes(dib_header, 32, 4, palette.size()); // number of colors in palette
+    set_bytes(dib_header, 36, 4, palette.size()); // number of important colors
+    vector<unsigned char> palette_entries(palette_bytes, 0);
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        palette_entries[i * 4] = palette[i].blue;
+        palette_entries[i * 4 + 1] = palette[i].green;
+        palette_entries[i * 4 + 2] = palette[i].red;
+    }
+    stream.write((char *)bmp_header, sizeof(bmp_header));
+    stream.write((char *)dib_header, sizeof(dib_header));
+    stream.write((char *)palette_entries.data(), palette_entries.size());
+    stream.write((char *)pixel_array.data(), pixel_array.size());
+    return static_cast<bool>(stream);
+}
+
+// compression value of a BMP whose pixel layout is given by color masks
+const int BMP_BITFIELDS = 3;
+
+// reads 24 and 32 bit BMPs like read_image, and also the 1, 4 and 8 bit palette ones write_bmp and other programs make.
+// the file is read in one go and the rows decoded in parallel instead of seeking to every pixel. returns an empty image
+// for anything it can't read
+vector<vector<Pixel>> read_bmp(const string &filename)
+{
+    ifstream stream(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        return {};
+    }
+    vector<unsigned char> data((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+    if (data.size() < 54 || data[0] != 'B' || data[1] != 'M')
+    {
+        return {};
+    }
+    auto field = [&data](int offset, int bytes)
+    {
+        unsigned value = 0;
+        for (int i = 0; i < bytes; i++)
+            value |= static_cast<unsigned>(data[offset + i]) << (i * 8);
+        return value;
+    };
+    // everything in the header is checked before it is used, a broken or hostile file just gives an empty image
+    long long file_bytes = data.size();
+    long long start = field(10, 4);
+    long long dib_size = field(14, 4);
+    int width = static_cast<int>(field(18, 4));
+    int stored_height = static_cast<int>(field(22, 4)); // negative for files stored top to bottom
+    int bits = field(28, 2);
+    int compression = field(30, 4);
+    unsigned colors_used = field(46, 4);
+    if (dib_size < 40 || width <= 0 || stored_height == 0 || stored_height == INT_MIN ||
+        (bits != 1 && bits != 4 && bits != 8 && bits != 24 && bits != 32))
+    {
+        return {};
+    }
+    int height = abs(stored_height);
+    if (compression == BMP_BITFIELDS && bits == 32)
+    {
+        // 32 bit files often say "bitfields" just to spell out the usual layout. the masks come right after the 40 byte
+        // header (or are the next fields of a bigger one), anything other than the usual blue, green, red order is refused
+        if (file_bytes < 66 || field(54, 4) != 0x00ff0000 || field(58, 4) != 0x0000ff00 || field(62, 4) != 0x000000ff)
+        {
+            return {};
+        }
+    }
+    else if (compression != 0)
+    {
+        return {};
+    }
+    long long row_bytes = (static_cast<long long>(width) * bits + 31) / 32 * 4;
+    if (row_bytes > file_bytes || height > file_bytes || start + row_bytes * height > file_bytes)
+    {
+        return {};
+    }
+
+    vector<Pixel> palette;
+    if (bits <= 8)
+    {
+        long long entries = colors_used == 0 ? 1 << bits : min<long long>(colors_used, 1 << bits);
+        long long palette_start = 14 + dib_size;
+        if (palette_start + entries * 4 > file_bytes)
+        {
+            return {};
+        }
+        for (long long i = 0; i < entries; i++)
+        {
+            const unsigned char *entry = &data[palette_start + i * 4];
+            palette.push_back({entry[2], entry[1], entry[0]});
+        }
+        palette.resize(1 << bits, Pixel()); // indexes past the palette read as black instead of out of bounds
+    }
+
+    vector<vector<Pixel>> image = acquire_image(height, width);
+    parallel_rows(height, [&](int first_row, int end_row)
+    {
+        for (int row = first_row; row < end_row; ++row)
+        {
+            int stored_row = stored_height > 0 ? height - 1 - row : row;
+            const unsigned char *bytes = &data[start + stored_row * row_bytes];
+            Pixel *pixels = image[row].data();
+            if (bits >= 24)
+            {
+                int step = bits / 8;
+                for (int col = 0; col < width; ++col)
+                {
+                    pixels[col] = {bytes[col * step + 2], bytes[col * step + 1], bytes[col * step]};
+                }
+            }
+            else
+            {
+                int per_byte = 8 / bits, mask = (1 << bits) - 1;
+                for (int col = 0; col < width; ++col)
+                {
+                    int shift = 8 - bits * (col % per_byte + 1);
+                    pixels[col] = palette[(bytes[col / per_byte] >> shift) & mask];
+                }
+            }
+        }
+    });
+    return image;
+}
+
+// one benchmark result, printed as a line of JSON
+struct BenchResult
+{
+    string name;
+    int width;
+    int height;
+    long iterations;
+    double best_ns;
+    double mean_ns;
+    double allocations; // per call
+    double allocated_bytes;
+    long peak_bytes; // most memory one call needed on top of what was already allocated
+    PerfSample perf; // totals over all the runs, only with --perf
+};
+
+// runs operation until it has taken min_seconds (at least once) and keeps the fastest run, the output images go back to
+// the pool between runs like they do in main
+BenchResult run_benchmark(const string &name, int width, int height, double min_seconds,
+                          const function<vector<vector<Pixel>>()> &operation)
+{
+    BenchResult result = {name, width, height, 0, 0, 0, 0, 0, 0, PerfSample()};
+    double total_ns = 0;
+    long total_count = 0;
+    long total_bytes = 0;
+    if (perf_counters.enabled)
+    {
+        perf_counters.start();
+    }
+    while (result.iterations == 0 || total_ns < min_seconds * 1e9)
+    {
+        long count_before = allocation_count;
+        long bytes_before = allocation_bytes;
+        long live_before = allocation_live_bytes;
+        reset_allocation_peak();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<vector<Pixel>> output = operation();
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        total_count += allocation_count - count_before;
+        total_bytes += allocation_bytes - bytes_before;
+        result.peak_bytes = max(result.peak_bytes, allocation_peak_bytes - live_before);
+        release_image(output);
+
+        double ns = chrono::duration<double, nano>(end - start).count();
+        if (result.iterations == 0 || ns < result.best_ns)
+        {
+            result.best_ns = ns;
+        }
+        total_ns += ns;
+        result.iterations++;
+    }
+    if (perf_counters.enabled)
+    {
+        result.perf = perf_counters.stop();
+    }
+    result.mean_ns = total_ns / result.iterations;
+    result.allocations = static_cast<double>(total_count) / result.iterations;
+    result.allocated_bytes = static_cast<double>(total_bytes) / result.iterations;
+    return result;
+}
+
+void print_bench_json(ostream &out, const BenchResult &result, bool last)
+{
+    double pixels = static_cast<double>(result.width) * result.height;
+    out << "    {\"name\": \"" << result.name << "\", \"width\": " << result.width << ", \"height\": " << result.height
+        << ", \"iterations\": " << result.iterations << ", \"best_ns\": " << static_cast<long long>(result.best_ns)
+        << ", \"mean_ns\": " << static_cast<long long>(result.mean_ns) << ", \"ns_per_pixel\": " << result.best_ns / pixels
+        << ", \"mpix_per_s\": " << pixels / result.best_ns * 1000 << ", \"allocations\": " << result.allocations
+        << ", \"allocated_bytes\": " << static_cast<long long>(result.allocated_bytes) << ", \"peak_bytes\": " << result.peak_bytes;
+    if (result.perf.any())
+    {
+        out << ", \"perf\": " << perf_json(result.perf, pixels, result.iterations);
+    }
+    out << "}" << (last ? "" : ",") << endl;
+}
+
+// --bench: times every filter, the rotation, the resizers and the BMP reader/writer on test images of each size, JSON
+// goes to cout and a readable line per result to cerr
+void run_benchmarks(const vector<int> &sizes, double min_seconds)
+{
+    vector<BenchResult> results;
+    const string temp_file = "bench_temp.bmp";
+
+    for (size_t s = 0; s < sizes.size(); s++)
+    {
+        int size = sizes[s];
+        const vector<vector<Pixel>> image = make_test_image(size, size);
+        vector<pair<string, function<vector<vector<Pixel>>()>>> operations;
+        operations.push_back(make_pair("process_1", [&]() { return process_1(image); }));
+        operations.push_back(make_pair("process_2", [&]() { return process_2(image); }));
+        operations.push_back(make_pair("process_3", [&]() { return process_3(image); }));
+        operations.push_back(make_pair("process_4", [&]() { return process_4(image); }));
+        operations.push_back(make_pair("rotate_by_90", [&]() { return rotate_by_90(image); }));
+        operations.push_back(make_pair("enlarge_2x", [&]() { return enlarge(image, 2, 2); }));
+        operations.push_back(make_pair("enlarge_1.5x", [&]() { return enlarge(image, 1.5, 1.5); }));
+        operations.push_back(make_pair("resample_bilinear_2x", [&]() { return resample(image, 2, 2, RESAMPLE_BILINEAR); }));
+        operations.push_back(make_pair("resample_bicubic_2x", [&]() { return resample(image, 2, 2, RESAMPLE_BICUBIC); }));
+        operations.push_back(make_pair("resample_lanczos_2x", [&]() { return resample(image, 2, 2, RESAMPLE_LANCZOS); }));
+        operations.push_back(make_pair("process_7", [&]() { return process_7(image); }));
+        operations.push_back(make_pair("process_8", [&]() { return process_8(image); }));
+        operations.push_back(make_pair("process_9", [&]() { return process_9(image); }));
+        operations.push_back(make_pair("process_10", [&]() { return process_10(image); }));
+        operations.push_back(make_pair("process_11", [&]() { return process_11(image); }));
+        operations.push_back(make_pair("process_12", [&]() { return process_12(image); }));
+        operations.push_back(make_pair("process_13", [&]() { return process_13(image); }));
+        operations.push_back(make_pair("process_14", [&]() { return process_14(image); }));
+        operations.push_back(make_pair("process_15", [&]() { return process_15(image); }));
+        operations.push_back(make_pair("blur_2", [&]() { return blur(image, 2); }));
+        operations.push_back(make_pair("blur_20", [&]() { return blur(image, 20); }));
+        operations.push_back(make_pair("process_17", [&]() { return process_17(image); }));
+        operations.push_back(make_pair("process_18", [&]() { return process_18(image); }));
+        operations.push_back(make_pair("sharpen_1", [&]() { return sharpen(image, 1, 1, 0); }));
+        operations.push_back(make_pair("sharpen_3", [&]() { return sharpen(image, 1, 3, 0); }));
+        operations.push_back(make_pair("median_2", [&]() { return median_filter(image, 2); }));
+        operations.push_back(make_pair("median_8", [&]() { return median_filter(image, 8); }));
+        operations.push_back(make_pair("open_3x3", [&]() { return morphology(image, MORPH_OPEN, 3, 3); }));
+        operations.push_back(make_pair("open_31x31", [&]() { return morphology(image, MORPH_OPEN, 31, 31); }));
+        vector<vector<Pixel>> black_and_white = process_7(image);
+        operations.push_back(make_pair("components", [&]() { return label_image(connected_components(black_and_white)); }));
+        operations.push_back(make_pair("dither_floyd_steinberg", [&]()
+        {
+            return dither(image, DITHER_BLACK_AND_WHITE, FLOYD_STEINBERG);
+        }));
+        operations.push_back(make_pair("dither_atkinson_5_colors", [&]()
+        {
+            return dither(image, DITHER_FIVE_COLORS, ATKINSON);
+        }));
+        Lut3D look = lut_from_filter(color_filter(11), DEFAULT_LUT_SIZE);
+        operations.push_back(make_pair("lut_trilinear", [&]() { return apply_lut(image, look, LUT_TRILINEAR); }));
+        operations.push_back(make_pair("lut_tetrahedral", [&]() { return apply_lut(image, look, LUT_TETRAHEDRAL); }));
+        PaletteMap web_palette = make_palette_map(load_palette("web"));
+        operations.push_back(make_pair("palette_web", [&]() { return apply_palette(image, web_palette); }));
+        operations.push_back(make_pair("convolve_7x7", [&]()
+        {
+            Kernel kernel = {7, vector<float>(49, 1.0f / 49), 0};
+            kernel.weights[0] = 0; // not separable, so this times the general tiled path
+            return convolve(image, kernel);
+        }));
+        operations.push_back(make_pair("write_image", [&]()
+        {
+            write_image(temp_file, image);
+            return vector<vector<Pixel>>();
+        }));
+        operations.push_back(make_pair("read_image", [&]() { return read_image(temp_file); }));
+        operations.push_back(make_pair("read_bmp", [&]() { return read_bmp(temp_file); }));
+        operations.push_back(make_pair("write_bmp_1_bit", [&]()
+        {
+            write_bmp(temp_file, black_and_white);
+            return vector<vector<Pixel>>();
+        }));
+        operations.push_back(make_pair("read_bmp_1_bit", [&]() { return read_bmp(temp_file); }));
+
+        for (size_t i = 0; i < operations.size(); i++)
+        {
+            BenchResult result = run_benchmark(operations[i].first, size, size, min_seconds, operations[i].second);
+            double pixels = static_cast<double>(size) * size;
+            cerr << result.name << " " << size << "x" << size << ": " << result.best_ns / pixels << " ns/pixel, "
+                 << pixels / result.best_ns * 1000 << " MPix/s, " << result.allocations << " allocations" << endl;
+            if (perf_counters.enabled)
+            {
+                cerr << "  " << describe_perf(result.perf, pixels * result.iterations) << endl;
+            }
+            results.push_back(result);
+        }
+        remove(temp_file.c_str());
+    }
+
+    cout << "{" << endl;
+    cout << "  \"threads\": " << thread::hardware_concurrency() << "," << endl;
+    cout << "  \"benchmarks\": [" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        print_bench_json(cout, results[i], i + 1 == results.size());
+    }
+    cout << "  ]" << endl;
+    cout << "}" << endl;
+}
+
+// one filter the --check mode runs, with the same settings the reference outputs were made with
+struct CheckCase
+{
+    int process;
+    function<vector<vector<Pixel>>(const vector<vector<Pixel>> &)> run;
+    bool has_reference; // compared with sample_images/processN.bmp, otherwise only timed
+    // true for a pixel where the reference image is known to disagree with this program (source pixel, our result, the
+    // reference's). every other pixel has to match exactly. empty when nothing is excused
+    function<bool(const Pixel &, const Pixel &, const Pixel &)> known_difference;
+};
+
+// process7.bmp was made with a float average: gray sums 381 and 382 (127 and 127.33) are black there and white here
+bool process_7_known_difference(const Pixel &source, const Pixel &result, const Pixel &expected)
+{
+    int sum = source.red + source.green + source.blue;
+    return (sum == 381 || sum == 382) && result.red == 255 && expected.red == 0;
+}
+
+// process10.bmp breaks a green and blue tie above red the other way: those pixels are red there and green here
+bool process_10_known_difference(const Pixel &source, const Pixel &result, const Pixel &expected)
+{
+    return source.green == source.blue && source.green > source.red && same_color(result, {0, 255, 0}) &&
+           same_color(expected, {255, 0, 0});
+}
+
+vector<CheckCase> check_cases()
+{
+    // 1-10 have to match their reference image exactly, apart from the one known difference each of 7 and 10 has
+    vector<CheckCase> cases;
+    cases.push_back({1, [](const vector<vector<Pixel>> &image) { return process_1(image); }, true, nullptr});
+    cases.push_back({2, [](const vector<vector<Pixel>> &image) { return process_2(image); }, true, nullptr});
+    cases.push_back({3, [](const vector<vector<Pixel>> &image) { return process_3(image); }, true, nullptr});
+    cases.push_back({4, [](const vector<vector<Pixel>> &image) { return process_4(image); }, true, nullptr});
+    cases.push_back({5, [](const vector<vector<Pixel>> &image) { return rotate_clockwise(image, 2); }, true, nullptr});
+    cases.push_back({6, [](const vector<vector<Pixel>> &image) { return enlarge(image, 2, 3); }, true, nullptr});
+    cases.push_back({7, [](const vector<vector<Pixel>> &image) { return process_7(image); }, true,
+                     process_7_known_difference});
+    cases.push_back({8, [](const vector<vector<Pixel>> &image) { return process_8(image); }, true, nullptr});
+    cases.push_back({9, [](const vector<vector<Pixel>> &image) { return process_9(image); }, true, nullptr});
+    cases.push_back({10, [](const vector<vector<Pixel>> &image) { return process_10(image); }, true,
+                     process_10_known_difference});
+    cases.push_back({11, [](const vector<vector<Pixel>> &image) { return process_11(image); }, false, nullptr}); // no reference image
+    cases.push_back({12, [](const vector<vector<Pixel>> &image) { return process_12(image); }, false, nullptr});
+    cases.push_back({13, [](const vector<vector<Pixel>> &image) { return process_13(image); }, false, nullptr});
+    cases.push_back({14, [](const vector<vector<Pixel>> &image) { return process_14(image); }, false, nullptr});
+    cases.push_back({15, [](const vector<vector<Pixel>> &image) { return process_15(image); }, false, nullptr});
+    cases.push_back({16, [](const vector<vector<Pixel>> &image) { return blur(image, 2); }, false, nullptr});
+    cases.push_back({17, [](const vector<vector<Pixel>> &image) { return process_17(image); }, false, nullptr});
+    cases.push_back({18, [](const vector<vector<Pixel>> &image) { return process_18(image); }, false, nullptr});
+    cases.push_back({19, [](const vector<vector<Pixel>> &image) { return sharpen(image, 1, 1, 0); }, false, nullptr});
+    cases.push_back({20, [](const vector<vector<Pixel>> &image) { return median_filter(image, 2); }, false, nullptr});
+    cases.push_back({21, [](const vector<vector<Pixel>> &image) { return morphology(image, MORPH_OPEN, 5, 5); }, false, nullptr});
+    cases.push_back({22, [](const vector<vector<Pixel>> &image)
+    {
+        return label_image(connected_components(process_7(image)));
+    }, false, nullptr});
+    cases.push_back({23, [](const vector<vector<Pixel>> &image)
+    {
+        return dither(image, DITHER_BLACK_AND_WHITE, FLOYD_STEINBERG);
+    }, false, nullptr});
+    cases.push_back({24, [](const vector<vector<Pixel>> &image)
+    {
+        return apply_lut(image, lut_from_filter(color_filter(11), DEFAULT_LUT_SIZE), LUT_TETRAHEDRAL);
+    }, false, nullptr});
+    cases.push_back({25, [](const vector<vector<Pixel>> &image)
+    {
+        return apply_palette(image, make_palette_map(load_palette("web")));
+    }, false, nullptr});
+    return cases;
+}
+
+// number of pixels that differ, or -1 if the sizes don't match
+long count_mismatches(const vector<vector<Pixel>> &result, const vector<vector<Pixel>> &expected)
+{
+    if (result.size() != expected.size() || result.empty() || result[0].size() != expected[0].size())
+    {
+        return -1;
+    }
+    long mismatches = 0;
+    for (size_t row = 0; row < result.size(); ++row)
+    {
+        for (size_t col = 0; col < result[row].size(); ++col)
+        {
+            const Pixel &a = result[row][col];
+            const Pixel &b = expected[row][col];
+            if (a.red != b.red || a.green != b.green || a.blue != b.blue)
+            {
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+// a check for a process that has no reference image: its output on a small generated image compared with a slow but
+// obviously right way of getting the same answer. the images are at least 64 rows (and columns where a filter splits
+// those) so that parallel_rows hands them out in strips on a 4 core machine, strip edges are where a bug would hide
+struct ReferenceCheck
+{
+    string name;
+    function<long()> run; // pixels that differ from the slow version, or -1 if the sizes don't match
+};
+
+vector<ReferenceCheck> reference_checks()
+{
+    vector<ReferenceCheck> checks;
+    // a dark scan: grays 10-29 and 90-109 scattered at random. process 7 would make all of it black, otsu has to put the
+    // threshold in the gap so the lighter group turns white
+    checks.push_back({"otsu_bimodal", []()
+    {
+        vector<vector<Pixel>> image = make_test_image(37, 67, PATTERN_NOISE, 7);
+        vector<vector<Pixel>> expected = image;
+        for (size_t row = 0; row < image.size(); ++row)
+        {
+            for (size_t col = 0; col < image[row].size(); ++col)
+            {
+                bool light = image[row][col].red % 2 == 1;
+                int gray = (light ? 90 : 10) + image[row][col].green % 20;
+                image[row][col] = {gray, gray, gray};
+                int value = light ? 255 : 0;
+                expected[row][col] = {value, value, value};
+            }
+        }
+        return count_mismatches(process_12(image), expected);
+    }});
+    // median_filter against sorting every window, edge pixels repeated past the edges the same way
+    checks.push_back({"median_vs_sort", []()
+    {
+        const int RADIUS = 3;
+        vector<vector<Pixel>> image = make_test_image(29, 67, PATTERN_NOISE, 3);
+        int width = image[0].size();
+        int height = image.size();
+        vector<vector<Pixel>> expected = image;
+        for (int row = 0; row < height; ++row)
+        {
+            for (int col = 0; col < width; ++col)
+            {
+                vector<int> values[3];
+                for (int y = row - RADIUS; y <= row + RADIUS; y++)
+                {
+                    for (int x = col - RADIUS; x <= col + RADIUS; x++)
+                    {
+                        const Pixel &p = image[min(height - 1, max(0, y))][min(width - 1, max(0, x))];
+                        values[0].push_back(p.red);
+                        values[1].push_back(p.green);
+                        values[2].push_back(p.blue);
+                    }
+                }
+                for (int c = 0; c < 3; c++)
+                {
+                    sort(values[c].begin(), values[c].end());
+                }
+                size_t middle = values[0].size() / 2;
+                expected[row][col] = {values[0][middle], values[1][middle], values[2][middle]};
+            }
+        }
+        return count_mismatches(median_filter(image, RADIUS), expected);
+    }});
+    // all four morphology operations with an even width and odd height against taking the min or max of every window
+    // (only the part of it inside the image)
+    checks.push_back({"morphology_vs_naive", []()
+    {
+        const int RECT_WIDTH = 4, RECT_HEIGHT = 3;
+        vector<vector<Pixel>> image = make_test_image(67, 65, PATTERN_NOISE, 5);
+        int width = image[0].size();
+        int height = image.size();
+        auto naive = [&](const vector<vector<int>> &in, bool dilate)
+        {
+            vector<vector<int>> out = in;
+            for (int row = 0; row < height; ++row)
+            {
+                for (int col = 0; col < width; ++col)
+                {
+                    int value = dilate ? 0 : 255;
+                    for (int y = max(0, row - RECT_HEIGHT / 2); y < min(height, row - RECT_HEIGHT / 2 + RECT_HEIGHT); y++)
+                    {
+                        for (int x = max(0, col - RECT_WIDTH / 2); x < min(width, col - RECT_WIDTH / 2 + RECT_WIDTH); x++)
+                        {
+                            value = dilate ? max(value, in[y][x]) : min(value, in[y][x]);
+                        }
+                    }
+                    out[row][col] = value;
+                }
+            }
+            return out;
+        };
+        vector<vector<int>> mask(height, vector<int>(width));
+        for (int row = 0; row < height; ++row)
+        {
+            for (int col = 0; col < width; ++col)
+            {
+                const Pixel &p = image[row][col];
+                mask[row][col] = (p.red + p.green + p.blue) / 3 >= 255 / 2 ? 255 : 0;
+            }
+        }
+
+        long mismatches = 0;
+        for (int operation = MORPH_ERODE; operation <= MORPH_CLOSE; operation++)
+        {
+            vector<vector<int>> result = mask;
+            if (operation == MORPH_ERODE || operation == MORPH_OPEN)
+                result = naive(result, false);
+            if (operation != MORPH_ERODE)
+                result = naive(result, true);
+            if (operation == MORPH_CLOSE)
+                result = naive(result, false);
+            vector<vector<Pixel>> expected(height, vector<Pixel>(width));
+            for (int row = 0; row < height; ++row)
+            {
+                for (int col = 0; col < width; ++col)
+                {
+                    int value = result[row][col];
+                    expected[row][col] = {value, value, value};
+                }
+            }
+            long differ = count_mismatches(morphology(image, operation, RECT_WIDTH, RECT_HEIGHT), expected);
+            if (differ < 0)
+                return differ;
+            mismatches += differ;
+        }
+        return mismatches;
+    }});
+    // connected_components against a flood fill from every pixel not reached yet, in row order so the component numbers
+    // come out the same. three colors at random make lots of small regions that cross the strips
+    checks.push_back({"components_vs_flood_fill", []()
+    {
+        vector<vector<Pixel>> image = make_test_image(41, 67, PATTERN_NOISE, 11);
+        int width = image[0].size();
+        int height = image.size();
+        for (int row = 0; row < height; ++row)
+        {
+            for (int col = 0; col < width; ++col)
+            {
+                image[row][col] = {image[row][col].red % 3 * 100, 0, 0};
+            }
+        }
+        vector<int> labels(width * height, -1);
+        int count = 0;
+        for (int start = 0; start < width * height; start++)
+        {
+            if (labels[start] >= 0)
+                continue;
+            vector<int> stack(1, start);
+            labels[start] = count;
+            while (!stack.empty())
+            {
+                int i = stack.back();
+                stack.pop_back();
+                int row = i / width, col = i % width;
+                const int neighbours[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+                for (int n = 0; n < 4; n++)
+                {
+                    int y = row + neighbours[n][0], x = col + neighbours[n][1];
+                    if (y < 0 || y >= height || x < 0 || x >= width || labels[y * width + x] >= 0 ||
+                        !same_color(image[y][x], image[row][col]))
+                        continue;
+                    labels[y * width + x] = count;
+                    stack.push_back(y * width + x);
+                }
+            }
+            count++;
+        }
+
+        Components found = connected_components(image);
+        if (static_cast<int>(found.components.size()) != count)
+        {
+            cout << "  found " << found.components.size() << " components, flood fill found " << count << endl;
+            return static_cast<long>(width) * height;
+        }
+        long mismatches = 0;
+        for (int i = 0; i < width * height; i++)
+        {
+            mismatches += found.labels[i] != labels[i];
+        }
+        return mismatches;
+    }});
+    // the wavefront dither against plain error diffusion, one pixel after another, for both color sets and both kernels
+    checks.push_back({"dither_vs_serial", []()
+    {
+        vector<vector<Pixel>> image = make_test_image(53, 67, PATTERN_PHOTO, 13);
+        int width = image[0].size();
+        int height = image.size();
+        const DiffusionKernel *kernels[2] = {&FLOYD_STEINBERG, &ATKINSON};
+        long mismatches = 0;
+        for (int colors = DITHER_BLACK_AND_WHITE; colors <= DITHER_FIVE_COLORS; colors++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                const DiffusionKernel &kernel = *kernels[k];
+                vector<vector<Pixel>> expected = image;
+                for (int row = 0; row < height; ++row)
+                {
+                    for (int col = 0; col < width; ++col)
+                    {
+                        Pixel &p = expected[row][col];
+                        Pixel chosen;
+                        int error[3];
+                        if (colors == DITHER_BLACK_AND_WHITE)
+                        {
+                            int gray_value = (p.red + p.green + p.blue) / 3;
+                            int value = gray_value >= 255 / 2 ? 255 : 0;
+                            chosen = {value, value, value};
+                            error[0] = error[1] = error[2] = gray_value - value;
+                        }
+                        else
+                        {
+                            Pixel clamped = {min(255, max(0, p.red)), min(255, max(0, p.green)), min(255, max(0, p.blue))};
+                            chosen = process_10_pixel(clamped);
+                            error[0] = clamped.red - chosen.red;
+                            error[1] = clamped.green - chosen.green;
+                            error[2] = clamped.blue - chosen.blue;
+                        }
+                        p = chosen;
+                        for (size_t t = 0; t < kernel.taps.size(); t++)
+                        {
+                            int x = col + kernel.taps[t].dx, y = row + kernel.taps[t].dy;
+                            if (x < 0 || x >= width || y >= height)
+                                continue;
+                            expected[y][x].red += error[0] * kernel.taps[t].weight / kernel.divisor;
+                            expected[y][x].green += error[1] * kernel.taps[t].weight / kernel.divisor;
+                            expected[y][x].blue += error[2] * kernel.taps[t].weight / kernel.divisor;
+                        }
+                    }
+                }
+                long differ = count_mismatches(dither(image, colors, kernel), expected);
+                if (differ < 0)
+                    return differ;
+                mismatches += differ;
+            }
+        }
+        return mismatches;
+    }});
+    // a LUT baked from a filter that changes nothing has to change nothing, at a few grid sizes (including ones where the
+    // grid points don't land on whole colors) and with both interpolations
+    checks.push_back({"lut_identity", []()
+    {
+        vector<vector<Pixel>> image = make_test_image(37, 67, PATTERN_NOISE, 17);
+        const int sizes[] = {2, 17, DEFAULT_LUT_SIZE, 64};
+        long mismatches = 0;
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            Lut3D lut = lut_from_filter([](const vector<vector<Pixel>> &grid) { return copy_image(grid); }, sizes[i]);
+            for (int method = LUT_TRILINEAR; method <= LUT_TETRAHEDRAL; method++)
+            {
+                long differ = count_mismatches(apply_lut(image, lut, method), image);
+                if (differ < 0)
+                    return differ;
+                mismatches += differ;
+            }
+        }
+        return mismatches;
+    }});
+    // the palette grid against trying every palette color (first one wins a tie), for the built in palettes and 256 random
+    // colors. a few pixels are pushed out of 0-255 the way process 1 leaves them
+    checks.push_back({"palette_vs_brute_force", []()
+    {
+        vector<vector<Pixel>> image = make_test_image(37, 67, PATTERN_NOISE, 19);
+        image[0][0] = {-20, 300, 128};
+        image[1][1] = {270, -1, 256};
+        vector<Pixel> random_colors;
+        for (int i = 0; i < MAX_PALETTE_COLORS; i++)
+        {
+            unsigned random = hash_pixel(i, 0, 23);
+            random_colors.push_back({static_cast<int>(random & 255), static_cast<int>((random >> 8) & 255),
+                                     static_cast<int>((random >> 16) & 255)});
+        }
+        const vector<Pixel> palettes[] = {load_palette("web"), load_palette("gray"), load_palette("five"), random_colors};
+        long mismatches = 0;
+        for (size_t i = 0; i < sizeof(palettes) / sizeof(palettes[0]); i++)
+        {
+            const vector<Pixel> &colors = palettes[i];
+            vector<vector<Pixel>> expected = image;
+            for (size_t row = 0; row < image.size(); ++row)
+            {
+                for (size_t col = 0; col < image[row].size(); ++col)
+                {
+                    const Pixel &p = image[row][col];
+                    Pixel clamped = {min(255, max(0, p.red)), min(255, max(0, p.green)), min(255, max(0, p.blue))};
+                    size_t best = 0;
+                    for (size_t k = 1; k < colors.size(); k++)
+                    {
+                        if (color_distance(clamped, colors[k]) < color_distance(clamped, colors[best]))
+                            best = k;
+                    }
+                    expected[row][col] = colors[best];
+                }
+            }
+            long differ = count_mismatches(apply_palette(image, make_palette_map(colors)), expected);
+            if (differ < 0)
+                return differ;
+            mismatches += differ;
+        }
+        return mismatches;
+    }});
+    // write_bmp then read_bmp has to give the image back at 24, 8 and 1 bits, for odd widths so every row needs padding
+    // (and 1 bit rows end part way through a byte). a one color image still makes a 1 bit file
+    checks.push_back({"bmp_round_trip", []()
+    {
+        const string temp_file = "check_temp.bmp";
+        const int widths[] = {1, 3, 5, 7, 13};
+        long mismatches = 0;
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]) && mismatches >= 0; w++)
+        {
+            vector<vector<Pixel>> noise = make_test_image(widths[w], 67, PATTERN_NOISE, 29);
+            vector<vector<Pixel>> flat(67, vector<Pixel>(widths[w], {100, 150, 200}));
+            const pair<int, vector<vector<Pixel>>> images[] = {
+                {24, noise},
+                {8, apply_palette(noise, make_palette_map(load_palette("web")))},
+                {1, process_7(noise)},
+                {1, flat}};
+            for (size_t i = 0; i < sizeof(images) / sizeof(images[0]) && mismatches >= 0; i++)
+            {
+                int bits = images[i].first;
+                // the bits per pixel the file actually got, so a fall back to 24 bits doesn't pass unnoticed
+                unsigned char header[30] = {0};
+                bool written = write_bmp(temp_file, images[i].second, bits);
+                ifstream file(temp_file, ios::binary);
+                file.read((char *)header, sizeof(header));
+                if (!written || header[28] != bits)
+                {
+                    cout << "  " << widths[w] << " pixels wide, asked for " << bits << " bits and got " << int(header[28]) << endl;
+                    mismatches = -1;
+                    break;
+                }
+                long differ = count_mismatches(read_bmp(temp_file), images[i].second);
+                mismatches = differ < 0 ? differ : mismatches + differ;
+            }
+        }
+        remove(temp_file.c_str());
+        return mismatches;
+    }});
+    return checks;
+}
+
+// reads "name nanoseconds" lines written by a previous --check run
+vector<pair<string, double>> read_check_baseline(const string &filename)
 {
-    int num_rotations;
-    cout << "enter the number of 90-degree clockwise rotations: ";
-    cin >> num_rotations;
-
-    num_rotations = num_rotations % 4;
-
-    vector<vector<Pixel>> result_image = image;
-    for (int i = 0; i < num_rotations; i++)
+    vector<pair<string, double>> baseline;
+    ifstream stream(filename);
+    string name;
+    double ns;
+    while (stream >> name >> ns)
     {
-        result_image = rotate_by_90(result_image);
+        baseline.push_back(make_pair(name, ns));
     }
-    return result_image;
+    return baseline;
 }
 
-// process 6: enlarge the image in the x and y direction
-vector<vector<Pixel>> process_6(const vector<vector<Pixel>> &image)
+// --check: runs every process on the tiny test image from Test_Debug.md and on sample.bmp and compares them with the
+// expected values, and runs the reference checks for the processes without reference images. with timing it also times them against the baseline file (written the first time, or with
+// --check-update). timings only mean something on the machine that wrote the baseline, so they are opt in.
+// returns the number of failures
+int run_checks(const string &reference_dir, const string &baseline_file, double threshold, bool timing_checks, bool update_baseline)
 {
-    int width = image[0].size();
-    int height = image.size();
-    double xscale, yscale;
+    int failures = 0;
+    const vector<vector<Pixel>> tiny =
+        {
+            {{0, 5, 10}, {15, 20, 25}, {30, 35, 40}, {45, 50, 55}},
+            {{60, 65, 70}, {75, 80, 85}, {90, 95, 100}, {105, 110, 115}},
+            {{120, 125, 130}, {135, 140, 145}, {150, 155, 160}, {165, 170, 175}}};
 
-    cout << "enter the scaling factor for x (horizontal): ";
-    cin >> xscale;
-    cout << "enter the scaling factor for y (vertical): ";
-    cin >> yscale;
+    // expected output for the tiny image, copied from Test_Debug.md
+    const vector<pair<int, vector<vector<Pixel>>>> tiny_expected = {
+        {1, {
+            {{0, 0, 1}, {5, 7, 9}, {15, 17, 20}, {17, 19, 21}},
+            {{18, 20, 21}, {47, 50, 53}, {75, 79, 83}, {65, 69, 72}},
+            {{37, 39, 40}, {84, 87, 90}, {125, 129, 133}, {103, 106, 109}}
+        }},
+        {2, {
+            {{0, 1, 3}, {4, 6, 7}, {9, 10, 12}, {13, 15, 16}},
+            {{18, 19, 21}, {22, 24, 25}, {90, 95, 100}, {105, 110, 115}},
+            {{120, 125, 130}, {135, 140, 145}, {150, 155, 160}, {228, 229, 231}}
+        }},
+        {3, {
+            {{5, 5, 5}, {20, 20, 20}, {35, 35, 35}, {50, 50, 50}},
+            {{65, 65, 65}, {80, 80, 80}, {95, 95, 95}, {110, 110, 110}},
+            {{125, 125, 125}, {140, 140, 140}, {155, 155, 155}, {170, 170, 170}}
+        }},
+        {4, {
+            {{120, 125, 130}, {60, 65, 70}, {0, 5, 10}},
+            {{135, 140, 145}, {75, 80, 85}, {15, 20, 25}},
+            {{150, 155, 160}, {90, 95, 100}, {30, 35, 40}},
+            {{165, 170, 175}, {105, 110, 115}, {45, 50, 55}}
+        }},
+        {5, {
+            {{165, 170, 175}, {150, 155, 160}, {135, 140, 145}, {120, 125, 130}},
+            {{105, 110, 115}, {90, 95, 100}, {75, 80, 85}, {60, 65, 70}},
+            {{45, 50, 55}, {30, 35, 40}, {15, 20, 25}, {0, 5, 10}}
+        }},
+        {6, {
+            {{0, 5, 10}, {0, 5, 10}, {15, 20, 25}, {15, 20, 25}, {30, 35, 40}, {30, 35, 40}, {45, 50, 55}, {45, 50, 55}},
+            {{0, 5, 10}, {0, 5, 10}, {15, 20, 25}, {15, 20, 25}, {30, 35, 40}, {30, 35, 40}, {45, 50, 55}, {45, 50, 55}},
+            {{0, 5, 10}, {0, 5, 10}, {15, 20, 25}, {15, 20, 25}, {30, 35, 40}, {30, 35, 40}, {45, 50, 55}, {45, 50, 55}},
+            {{60, 65, 70}, {60, 65, 70}, {75, 80, 85}, {75, 80, 85}, {90, 95, 100}, {90, 95, 100}, {105, 110, 115}, {105, 110, 115}},
+            {{60, 65, 70}, {60, 65, 70}, {75, 80, 85}, {75, 80, 85}, {90, 95, 100}, {90, 95, 100}, {105, 110, 115}, {105, 110, 115}},
+            {{60, 65, 70}, {60, 65, 70}, {75, 80, 85}, {75, 80, 85}, {90, 95, 100}, {90, 95, 100}, {105, 110, 115}, {105, 110, 115}},
+            {{120, 125, 130}, {120, 125, 130}, {135, 140, 145}, {135, 140, 145}, {150, 155, 160}, {150, 155, 160}, {165, 170, 175}, {165, 170, 175}},
+            {{120, 125, 130}, {120, 125, 130}, {135, 140, 145}, {135, 140, 145}, {150, 155, 160}, {150, 155, 160}, {165, 170, 175}, {165, 170, 175}},
+            {{120, 125, 130}, {120, 125, 130}, {135, 140, 145}, {135, 140, 145}, {150, 155, 160}, {150, 155, 160}, {165, 170, 175}, {165, 170, 175}}
+        }},
+        {7, {
+            {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}},
+            {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}},
+            {{0, 0, 0}, {255, 255, 255}, {255, 255, 255}, {255, 255, 255}}
+        }},
+        {8, {
+            {{127, 130, 132}, {135, 137, 140}, {142, 145, 147}, {150, 152, 155}},
+            {{157, 160, 162}, {165, 167, 170}, {172, 175, 177}, {180, 182, 185}},
+            {{187, 190, 192}, {195, 197, 200}, {202, 205, 207}, {210, 212, 215}}
+        }},
+        {9, {
+            {{0, 2, 5}, {7, 10, 12}, {15, 17, 20}, {22, 25, 27}},
+            {{30, 32, 35}, {37, 40, 42}, {45, 47, 50}, {52, 55, 57}},
+            {{60, 62, 65}, {67, 70, 72}, {75, 77, 80}, {82, 85, 87}}
+        }},
+        {10, {
+            {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}},
+            {{0, 0, 255}, {0, 0, 255}, {0, 0, 255}, {0, 0, 255}},
+            {{0, 0, 255}, {0, 0, 255}, {0, 0, 255}, {0, 0, 255}}
+        }}
+    };
 
-    int new_width = static_cast<int>(width * xscale);
-    int new_height = static_cast<int>(height * yscale);
-    vector<vector<Pixel>> new_image(new_height, vector<Pixel>(new_width));
+    vector<CheckCase> cases = check_cases();
+    for (size_t i = 0; i < tiny_expected.size(); i++)
+    {
+        for (size_t c = 0; c < cases.size(); c++)
+        {
+            if (cases[c].process != tiny_expected[i].first)
+            {
+                continue;
+            }
+            long mismatches = count_mismatches(cases[c].run(tiny), tiny_expected[i].second);
+            bool passed = mismatches == 0;
+            cout << (passed ? "PASS" : "FAIL") << " tiny process_" << cases[c].process;
+            if (!passed)
+            {
+                cout << " (" << (mismatches < 0 ? "wrong size" : to_string(mismatches) + " pixels differ") << ")";
+                failures++;
+            }
+            cout << endl;
+        }
+    }
 
-    for (int row = 0; row < new_height; ++row)
+    vector<ReferenceCheck> references = reference_checks();
+    for (size_t i = 0; i < references.size(); i++)
     {
-        for (int col = 0; col < new_width; ++col)
+        long mismatches = references[i].run();
+        bool passed = mismatches == 0;
+        cout << (passed ? "PASS" : "FAIL") << " reference " << references[i].name;
+        if (!passed)
         {
-            new_image[row][col] = image[static_cast<int>(row / yscale)][static_cast<int>(col / xscale)];
+            cout << " (" << (mismatches < 0 ? "wrong size" : to_string(mismatches) + " pixels differ") << ")";
+            failures++;
         }
+        cout << endl;
     }
-    return new_image;
-}
 
-// process 7: convert to high contrast
-vector<vector<Pixel>> process_7(const vector<vector<Pixel>> &image)
-{
-    int width = image[0].size();
-    int height = image.size();
-    vector<vector<Pixel>> new_image(height, vector<Pixel>(width));
+    vector<vector<Pixel>> sample = read_image(reference_dir + "/sample.bmp");
+    if (sample.empty())
+    {
+        cout << "FAIL could not read " << reference_dir << "/sample.bmp" << endl;
+        return failures + 1;
+    }
 
-    for (int row = 0; row < height; ++row)
+    timing_checks = timing_checks || update_baseline;
+    vector<pair<string, double>> baseline;
+    if (timing_checks && !update_baseline)
     {
-        for (int col = 0; col < width; ++col)
+        baseline = read_check_baseline(baseline_file);
+    }
+    vector<pair<string, double>> timings;
+    for (size_t c = 0; c < cases.size(); c++)
+    {
+        string name = "process_" + to_string(cases[c].process);
+        if (cases[c].has_reference)
         {
-            Pixel p = image[row][col];
-            int gray_value = (p.red + p.green + p.blue) / 3;
-
-            // where the high contrast magic is happening
-            Pixel new_pixel;
-            if (gray_value >= 255 / 2)
+            string reference_file = reference_dir + "/process" + to_string(cases[c].process) + ".bmp";
+            vector<vector<Pixel>> expected = read_image(reference_file);
+            vector<vector<Pixel>> result = cases[c].run(sample);
+            long mismatches = expected.empty() ? -1 : count_mismatches(result, expected);
+            long excused = 0; // mismatches that are the process's known difference
+            for (size_t row = 0; mismatches > 0 && cases[c].known_difference && row < result.size(); ++row)
             {
-                new_pixel = {255, 255, 255};
+                for (size_t col = 0; col < result[row].size(); ++col)
+                {
+                    const Pixel &a = result[row][col];
+                    const Pixel &b = expected[row][col];
+                    if (!same_color(a, b) && cases[c].known_difference(sample[row][col], a, b))
+                        excused++;
+                }
             }
-            else
+            bool passed = mismatches == excused;
+            cout << (passed ? "PASS" : "FAIL") << " golden " << name << " vs " << reference_file;
+            if (mismatches < 0)
+            {
+                cout << " (wrong size or unreadable)";
+            }
+            else if (mismatches > 0)
+            {
+                cout << " (" << mismatches - excused << " pixels differ, " << excused << " known differences)";
+            }
+            cout << endl;
+            failures += passed ? 0 : 1;
+            release_image(result);
+        }
+
+        if (!timing_checks)
+        {
+            continue;
+        }
+        BenchResult timing = run_benchmark(name, sample[0].size(), sample.size(), 0.25, [&]() { return cases[c].run(sample); });
+        timings.push_back(make_pair(name, timing.best_ns));
+        for (size_t b = 0; b < baseline.size(); b++)
+        {
+            if (baseline[b].first != name)
             {
-                new_pixel = {0, 0, 0};
+                continue;
             }
+            double ratio = timing.best_ns / baseline[b].second;
+            bool passed = ratio <= 1 + threshold;
+            cout << (passed ? "PASS" : "FAIL") << " timing " << name << " " << timing.best_ns / 1e6 << " ms (baseline "
+                 << baseline[b].second / 1e6 << " ms, " << (ratio - 1) * 100 << "%)" << endl;
+            failures += passed ? 0 : 1;
+        }
+    }
 
-            new_image[row][col] = new_pixel;
+    if (timing_checks && baseline.empty())
+    {
+        ofstream stream(baseline_file);
+        for (size_t i = 0; i < timings.size(); i++)
+        {
+            stream << timings[i].first << " " << static_cast<long long>(timings[i].second) << endl;
         }
+        cout << "wrote timing baseline " << baseline_file << endl;
     }
 
-    return new_image;
+    cout << (failures == 0 ? "all checks passed" : to_string(failures) + " check(s) failed") << endl;
+    return failures;
 }
 
-// process 8: lighten the image by a scaling factor
-vector<vector<Pixel>> process_8(const vector<vector<Pixel>> &image)
+// turns "256,512,1024" into {256, 512, 1024}
+vector<int> parse_sizes(const string &text)
 {
-    int width = image[0].size();
-    int height = image.size();
-    vector<vector<Pixel>> new_image(height, vector<Pixel>(width));
-
-    double scaling_factor = 0.5; // change this to any desired value -- piazza post on scaling is wrong, have to guess and check to match the example picture
-
-    for (int row = 0; row < height; ++row)
+    vector<int> sizes;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ','))
     {
-        for (int col = 0; col < width; ++col)
+        int size = atoi(item.c_str());
+        if (size > 0)
         {
-            Pixel p = image[row][col];
-            int new_red = static_cast<int>(255 - (255 - p.red) * scaling_factor);
-            int new_green = static_cast<int>(255 - (255 - p.green) * scaling_factor);
-            int new_blue = static_cast<int>(255 - (255 - p.blue) * scaling_factor);
-            new_image[row][col] = {new_red, new_green, new_blue};
+            sizes.push_back(size);
         }
     }
-
-    return new_image;
+    return sizes;
 }
 
-// process 9: darken the image by a scaling factor
-vector<vector<Pixel>> process_9(const vector<vector<Pixel>> &image)
+// everything --stats reports about one pass through the menu (read, one process, write)
+struct JobStats
 {
-    int width = image[0].size();
-    int height = image.size();
-    vector<vector<Pixel>> new_image(height, vector<Pixel>(width));
+    int choice;
+    string input_file;
+    string output_file;
+    int width;
+    int height;
+    int output_width;
+    int output_height;
+    StageStats read;
+    StageStats process;
+    StageStats write;
+    long bytes_read;
+    long bytes_written;
+    long peak_rss_kb;
+    PerfSample process_perf; // only with --perf
+    string input_stats_json;  // only with --image-stats
+    string output_stats_json;
+};
 
-    double scaling_factor = 0.5; // change this to any desired value, i changed to 0.5 because it was closest to the example picture (the piazza measurement is wrong)
+// size of a file in bytes, -1 if it can't be opened
+long file_size_of(const string &filename)
+{
+    ifstream stream(filename, ios::in | ios::binary | ios::ate);
+    if (!stream.is_open())
+    {
+        return -1;
+    }
+    return static_cast<long>(stream.tellg());
+}
 
-    for (int row = 0; row < height; ++row)
+// largest resident memory the process has used so far, in kilobytes
+long peak_rss_kb()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
     {
-        for (int col = 0; col < width; ++col)
-        {
-            Pixel p = image[row][col];
-            int new_red = static_cast<int>(p.red * scaling_factor);
-            int new_green = static_cast<int>(p.green * scaling_factor);
-            int new_blue = static_cast<int>(p.blue * scaling_factor);
-            new_image[row][col] = {new_red, new_green, new_blue};
-        }
+        return -1;
     }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // macOS reports bytes, linux reports kilobytes
+#else
+    return usage.ru_maxrss;
+#endif
+}
 
-    return new_image;
+// megapixels per second for a stage that went through the given number of pixels
+double mpix_per_s(long pixels, const StageStats &time)
+{
+    return time.wall_ms > 0 ? pixels / (time.wall_ms * 1000.0) : 0;
 }
 
-// process 10: convert to black, white, red, blue, and green - the picture is really intense, hardly see green in the example
-vector<vector<Pixel>> process_10(const vector<vector<Pixel>> &image)
+// "12 allocations, 4608 KB, peak +4608 KB"
+string describe_allocations(const StageStats &stage)
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    vector<vector<Pixel>> processed_image(num_rows, vector<Pixel>(num_columns));
+    stringstream out;
+    out << stage.allocations << " allocations, " << stage.allocated_bytes / 1024 << " KB, peak +" << stage.peak_bytes / 1024 << " KB";
+    return out.str();
+}
 
-    for (int i = 0; i < num_rows; i++)
+void print_job_stats(const JobStats &stats)
+{
+    long pixels = static_cast<long>(stats.width) * stats.height;
+    long output_pixels = static_cast<long>(stats.output_width) * stats.output_height;
+    cout << "stats: " << stats.width << "x" << stats.height << " -> " << stats.output_width << "x" << stats.output_height << endl;
+    cout << "  read_bmp:  " << stats.read.wall_ms << " ms wall, " << stats.read.cpu_ms << " ms cpu, "
+         << stats.bytes_read << " bytes, " << mpix_per_s(pixels, stats.read) << " MPix/s, " << describe_allocations(stats.read) << endl;
+    cout << "  process_" << stats.choice << ": " << stats.process.wall_ms << " ms wall, " << stats.process.cpu_ms << " ms cpu, "
+         << mpix_per_s(pixels, stats.process) << " MPix/s, " << describe_allocations(stats.process) << endl;
+    cout << "  write_bmp: " << stats.write.wall_ms << " ms wall, " << stats.write.cpu_ms << " ms cpu, "
+         << stats.bytes_written << " bytes, " << mpix_per_s(output_pixels, stats.write) << " MPix/s, "
+         << describe_allocations(stats.write) << endl;
+    cout << "  peak memory: " << stats.peak_rss_kb << " KB" << endl;
+}
+
+string stage_json(const StageStats &time)
+{
+    stringstream out;
+    out << "{\"wall_ms\": " << time.wall_ms << ", \"cpu_ms\": " << time.cpu_ms << ", \"allocations\": " << time.allocations
+        << ", \"allocated_bytes\": " << time.allocated_bytes << ", \"peak_bytes\": " << time.peak_bytes << "}";
+    return out.str();
+}
+
+// appends one JSON line for the job to the --stats-log file
+void append_job_stats(const string &log_file, const JobStats &stats)
+{
+    ofstream log(log_file, ios::app);
+    if (!log.is_open())
     {
-        for (int j = 0; j < num_columns; j++)
-        {
-            Pixel current_pixel = image[i][j];
-            Pixel new_pixel;
+        cerr << "error, could not open stats log " << log_file << endl;
+        return;
+    }
+    long pixels = static_cast<long>(stats.width) * stats.height;
+    log << "{\"operation\": \"process_" << stats.choice << "\", \"input\": \"" << json_escape(stats.input_file)
+        << "\", \"output\": \"" << json_escape(stats.output_file) << "\", \"width\": " << stats.width
+        << ", \"height\": " << stats.height << ", \"output_width\": " << stats.output_width
+        << ", \"output_height\": " << stats.output_height << ", \"read\": " << stage_json(stats.read)
+        << ", \"process\": " << stage_json(stats.process) << ", \"write\": " << stage_json(stats.write)
+        << ", \"bytes_read\": " << stats.bytes_read << ", \"bytes_written\": " << stats.bytes_written
+        << ", \"process_mpix_per_s\": " << mpix_per_s(pixels, stats.process) << ", \"peak_rss_kb\": " << stats.peak_rss_kb;
+    if (!stats.input_stats_json.empty())
+    {
+        log << ", \"input_stats\": " << stats.input_stats_json << ", \"output_stats\": " << stats.output_stats_json;
+    }
+    if (stats.process_perf.any())
+    {
+        log << ", \"process_perf\": " << perf_json(stats.process_perf, pixels);
+    }
+    log << "}" << endl;
+}
 
-            int red_value = current_pixel.red;
-            int green_value = current_pixel.green;
-            int blue_value = current_pixel.blue;
-            int max_color = max({red_value, green_value, blue_value});
+int main(int argc, char *argv[])
+{
+    string quit_choice;
+    int choice;
+    string input_file, output_file;
+    vector<vector<Pixel>> image;
+    bool show_pool_stats = false;
+    bool show_stats = false;
+    bool show_image_stats = false;
+    string stats_log;
+    string trace_file;
+    bool benchmark = false;
+    bool generate = false;
+    string generate_file;
+    int generate_width = 0, generate_height = 0, generate_pattern = PATTERN_PHOTO;
+    unsigned generate_seed = 1;
+    int make_lut = 0; // process number for --make-lut
+    int bmp_bits = BMP_BITS_AUTO;
+    string make_lut_filename;
+    int make_lut_size = DEFAULT_LUT_SIZE;
+    vector<int> bench_sizes = {256, 512, 1024, 2048};
+    double bench_seconds = 0.2;
+    bool check = false;
+    bool check_timing = false;
+    bool check_update = false;
+    string check_dir = "sample_images";
+    string check_baseline = "check_baseline.txt";
+    double check_threshold = 0.5; // timings on a shared machine easily wander 20-30%
 
-            if (red_value + green_value + blue_value >= 550)
-            {
-                // full white
-                new_pixel.red = 255;
-                new_pixel.green = 255;
-                new_pixel.blue = 255;
-            }
-            else if (red_value + green_value + blue_value <= 150)
+    // command line options, the menu works the same without any of them
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--pool-cap" && i + 1 < argc)
+        {
+            image_pool.max_bytes = atol(argv[++i]) << 20;
+        }
+        else if (arg == "--pool-stats")
+        {
+            show_pool_stats = true;
+        }
+        else if (arg == "--stats")
+        {
+            show_stats = true;
+        }
+        else if (arg == "--stats-log" && i + 1 < argc)
+        {
+            stats_log = argv[++i];
+        }
+        else if (arg == "--check")
+        {
+            check = true;
+        }
+        else if (arg == "--check-dir" && i + 1 < argc)
+        {
+            check_dir = argv[++i];
+        }
+        else if (arg == "--check-baseline" && i + 1 < argc)
+        {
+            check_baseline = argv[++i];
+        }
+        else if (arg == "--check-threshold" && i + 1 < argc)
+        {
+            check_threshold = atof(argv[++i]);
+        }
+        else if (arg == "--check-timing")
+        {
+            check_timing = true;
+        }
+        else if (arg == "--check-update")
+        {
+            check_update = true;
+        }
+        else if (arg == "--generate" && i + 3 < argc)
+        {
+            generate = true;
+            generate_file = argv[++i];
+            generate_width = atoi(argv[++i]);
+            generate_height = atoi(argv[++i]);
+            // optional pattern name and seed
+            if (i + 1 < argc && argv[i + 1][0] != '-')
             {
-                // full dark
-                new_pixel.red = 0;
-                new_pixel.green = 0;
-                new_pixel.blue = 0;
+                string name = argv[++i];
+                generate_pattern = -1;
+                for (int p = 0; p < NUM_PATTERNS; p++)
+                {
+                    if (name == PATTERN_NAMES[p])
+                    {
+                        generate_pattern = p;
+                    }
+                }
+                if (generate_pattern < 0)
+                {
+                    cerr << "unknown pattern " << name << " (mix, gradient, noise, checker or photo)" << endl;
+                    return 1;
+                }
             }
-            else if (max_color == red_value)
+            if (i + 1 < argc && argv[i + 1][0] != '-')
             {
-                // red
-                new_pixel.red = 255;
-                new_pixel.green = 0;
-                new_pixel.blue = 0;
+                generate_seed = static_cast<unsigned>(atol(argv[++i]));
             }
-            else if (max_color == green_value)
+        }
+        else if (arg == "--make-lut" && i + 2 < argc)
+        {
+            make_lut = atoi(argv[++i]);
+            make_lut_filename = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
             {
-                // green
-                new_pixel.red = 0;
-                new_pixel.green = 255;
-                new_pixel.blue = 0;
+                make_lut_size = atoi(argv[++i]);
             }
-            else
+        }
+        else if (arg == "--bmp-bits" && i + 1 < argc)
+        {
+            string bits = argv[++i];
+            bmp_bits = bits == "auto" ? BMP_BITS_AUTO : atoi(bits.c_str());
+            if (bmp_bits != BMP_BITS_AUTO && bmp_bits != 1 && bmp_bits != 8 && bmp_bits != 24)
             {
-                // blue
-                new_pixel.red = 0;
-                new_pixel.green = 0;
-                new_pixel.blue = 255;
+                cerr << "--bmp-bits must be 1, 8, 24 or auto" << endl;
+                return 1;
             }
-
-            processed_image[i][j] = new_pixel;
+        }
+        else if (arg == "--image-stats")
+        {
+            show_image_stats = true;
+        }
+        else if (arg == "--perf")
+        {
+            perf_counters.enabled = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+            tracer.enabled = true;
+        }
+        else if (arg == "--bench")
+        {
+            benchmark = true;
+        }
+        else if (arg == "--bench-sizes" && i + 1 < argc)
+        {
+            bench_sizes = parse_sizes(argv[++i]);
+        }
+        else if (arg == "--bench-time" && i + 1 < argc)
+        {
+            bench_seconds = atof(argv[++i]);
+        }
+        else
+        {
+            cerr << "unknown option " << arg << endl;
+            cerr << "usage: " << argv[0] << " [--pool-cap MB] [--pool-stats] [--stats] [--stats-log FILE] [--image-stats]" << endl;
+            cerr << "       " << string(string(argv[0]).size(), ' ') << " [--trace FILE] [--perf] [--bmp-bits 1|8|24|auto]" << endl;
+            cerr << "       " << argv[0] << " --bench [--bench-sizes 256,512,...] [--bench-time SECONDS] [--perf]" << endl;
+            cerr << "       " << argv[0] << " --generate FILE WIDTH HEIGHT [mix|gradient|noise|checker|photo] [SEED]" << endl;
+            cerr << "       " << argv[0] << " --check [--check-dir DIR] [--check-timing] [--check-baseline FILE] [--check-threshold FRACTION] [--check-update]" << endl;
+            cerr << "       " << argv[0] << " --make-lut PROCESS FILE.cube [SIZE]" << endl;
+            return 1;
         }
     }
 
-    return processed_image;
-}
-
-// process 11: turn image into sailormoon vaporwave pink
-vector<vector<Pixel>> process_11(const vector<vector<Pixel>> &image)
-{
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    vector<vector<Pixel>> processed_image(num_rows, vector<Pixel>(num_columns));
-
-    for (int i = 0; i < num_rows; i++)
+    if (generate)
     {
-        for (int j = 0; j < num_columns; j++)
-        {
-            Pixel current_pixel = image[i][j];
-            Pixel new_pixel;
-
-            // apply a cream pink tint, have to guess and check the severity
-            new_pixel.red = min(255, static_cast<int>(current_pixel.red * 1.1 + 100));
-            new_pixel.green = min(255, static_cast<int>(current_pixel.green * 0.8 + 70));
-            new_pixel.blue = min(255, static_cast<int>(current_pixel.blue * 0.8 + 70));
-
-            processed_image[i][j] = new_pixel;
-        }
+        return generate_image_file(generate_file, generate_width, generate_height, generate_pattern, generate_seed) ? 0 : 1;
     }
 
-    return processed_image;
-}
+    if (make_lut)
+    {
+        return make_lut_file(make_lut, make_lut_filename, make_lut_size) ? 0 : 1;
+    }
 
-bool ends_with(const std::string &str, const std::string &suffix)
-{
-    if (str.size() < suffix.size())
-        return false;
-    return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
-}
+    if (check)
+    {
+        return run_checks(check_dir, check_baseline, check_threshold, check_timing, check_update) == 0 ? 0 : 1;
+    }
 
-int main()
-{
-    char quit_choice;
-    int choice;
-    string input_file, output_file;
-    vector<vector<Pixel>> image;
+    if (benchmark)
+    {
+        run_benchmarks(bench_sizes, bench_seconds);
+        return 0;
+    }
 
     while (true)
     {
@@ -649,13 +5194,21 @@ int main()
         display_menu();
         cin >> quit_choice;
 
-        if (quit_choice == 'Q' || quit_choice == 'q')
+        if (quit_choice == "Q" || quit_choice == "q")
         {
             cout << "thank you, come again... quitting!" << endl;
+            if (show_pool_stats)
+            {
+                print_pool_stats();
+            }
+            if (!trace_file.empty() && !write_trace(trace_file))
+            {
+                cerr << "error, could not write trace " << trace_file << endl;
+            }
             break;
         }
 
-        if (quit_choice == 'C' || quit_choice == 'c')
+        if (quit_choice == "C" || quit_choice == "c")
         {
             while (true)
             {
@@ -673,27 +5226,10 @@ int main()
             continue;
         }
 
-        if (isdigit(quit_choice))
+        // the choice is read as a whole word now that there are more than 11 options
+        if (!quit_choice.empty() && all_of(quit_choice.begin(), quit_choice.end(), ::isdigit))
         {
-            choice = quit_choice - '0';
-
-            if (choice == 1)
-            {
-                char next_digit;
-                cin.get(next_digit);
-                if (next_digit == '0')
-                {
-                    choice = 10;
-                }
-                else if (next_digit == '1')
-                {
-                    choice = 11;
-                }
-                else
-                {
-                    cin.putback(next_digit);
-                }
-            }
+            choice = atoi(quit_choice.c_str());
         }
         else
         {
@@ -701,7 +5237,7 @@ int main()
             continue;
         }
 
-        if (choice < 1 || choice > 11)
+        if (choice < 1 || choice > LAST_MENU_CHOICE)
         {
             cerr << "invalid choice, try again." << endl;
             continue;
@@ -721,14 +5257,40 @@ int main()
             }
         }
 
-        image = read_image(input_file);
+        JobStats stats = {};
+        stats.choice = choice;
+        stats.input_file = input_file;
+        stats.output_file = output_file;
+
+        TraceSpan job_span("job " + input_file + " -> " + output_file, "job");
+        Stopwatch read_watch;
+        {
+            TraceSpan span("read_bmp", "decode");
+            image = read_bmp(input_file);
+        }
+        stats.read = read_watch.elapsed();
         if (image.empty())
         {
             cerr << "error, could not read file " << input_file << endl;
             continue;
         }
+        stats.width = image[0].size();
+        stats.height = image.size();
+        if (show_image_stats)
+        {
+            // before the filter, since most of them take the input image over
+            ImageStats input_stats = image_stats(image);
+            print_image_stats("input " + input_file, input_stats);
+            stats.input_stats_json = image_stats_json(input_stats);
+        }
 
         vector<vector<Pixel>> processed_image;
+        Stopwatch process_watch;
+        TraceSpan process_span("process_" + to_string(choice), "filter");
+        if (perf_counters.enabled)
+        {
+            perf_counters.start();
+        }
         switch (choice)
         {
         case 1:
@@ -738,7 +5300,7 @@ int main()
             processed_image = process_2(image);
             break;
         case 3:
-            processed_image = process_3(image);
+            processed_image = process_3(move(image)); // image is read again next time, so let the filter take it over
             break;
         case 4:
             processed_image = process_4(image);
@@ -750,26 +5312,82 @@ int main()
             processed_image = process_6(image);
             break;
         case 7:
-            processed_image = process_7(image);
+            processed_image = process_7(move(image));
             break;
         case 8:
-            processed_image = process_8(image);
+            processed_image = process_8(move(image));
             break;
         case 9:
-            processed_image = process_9(image);
+            processed_image = process_9(move(image));
             break;
         case 10:
-            processed_image = process_10(image);
+            processed_image = process_10(move(image));
             break;
         case 11:
-            processed_image = process_11(image);
+            processed_image = process_11(move(image));
+            break;
+        case 12:
+            processed_image = process_12(move(image));
+            break;
+        case 13:
+            processed_image = process_13(move(image));
+            break;
+        case 14:
+            processed_image = process_14(move(image));
+            break;
+        case 15:
+            processed_image = process_15(move(image));
+            break;
+        case 16:
+            processed_image = process_16(image);
+            break;
+        case 17:
+            processed_image = process_17(image);
+            break;
+        case 18:
+            processed_image = process_18(image);
+            break;
+        case 19:
+            processed_image = process_19(image);
+            break;
+        case 20:
+            processed_image = process_20(image);
+            break;
+        case 21:
+            processed_image = process_21(image);
+            break;
+        case 22:
+            processed_image = process_22(image);
+            break;
+        case 23:
+            processed_image = process_23(image);
+            break;
+        case 24:
+            processed_image = process_24(image);
+            break;
+        case 25:
+            processed_image = process_25(image);
             break;
         default:
             cerr << "invalid choice, try again." << endl;
             continue;
         }
+        stats.process = process_watch.elapsed();
+        if (perf_counters.enabled)
+        {
+            stats.process_perf = perf_counters.stop();
+            cout << "perf process_" << choice << ": " << describe_perf(stats.process_perf, static_cast<double>(stats.width) * stats.height) << endl;
+        }
+        process_span.finish();
 
-        if (!write_image(output_file, processed_image))
+        Stopwatch write_watch;
+        bool written;
+        {
+            TraceSpan span("write_bmp", "encode");
+            written = write_bmp(output_file, processed_image, bmp_bits);
+        }
+        stats.write = write_watch.elapsed();
+        if (!written)
         {
             cerr << "error, could not write file " << output_file << endl;
         }
@@ -777,6 +5395,34 @@ int main()
         {
             cout << "altered image saved as " << output_file << " " << endl;
         }
+
+        if (show_image_stats)
+        {
+            ImageStats output_stats = image_stats(processed_image);
+            print_image_stats("output " + output_file, output_stats);
+            stats.output_stats_json = image_stats_json(output_stats);
+        }
+
+        if (show_stats || !stats_log.empty())
+        {
+            stats.output_width = processed_image[0].size();
+            stats.output_height = processed_image.size();
+            stats.bytes_read = file_size_of(input_file);
+            stats.bytes_written = written ? file_size_of(output_file) : 0;
+            stats.peak_rss_kb = peak_rss_kb();
+            if (show_stats)
+            {
+                print_job_stats(stats);
+            }
+            if (!stats_log.empty())
+            {
+                append_job_stats(stats_log, stats);
+            }
+        }
+
+        // done with both, let the next pass reuse them
+        release_image(processed_image);
+        release_image(image);
     }
 
     return 0;